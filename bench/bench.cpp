@@ -0,0 +1,213 @@
+#include "lib/Console.hpp"
+
+#include "ftxui/dom/node.hpp"
+#include "ftxui/screen/screen.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+
+// Benchmarks of the fetch, parse, aggregate and render stages.
+// Network traffic is replayed from the recordings in bench/fixtures (London, 16 days, hourly and overview).
+// Prints one json object per benchmark: name, iterations, ns/op and allocations/op,
+// or name, bytes and bytes per city-day for the memory and payload ones.
+// With FORECAST_FRAME_ALLOCATION_BUDGET set, exits with 1 when drawing a table frame allocates more than that.
+
+static std::atomic<uint64_t> allocations = 0;
+static std::atomic<int64_t> live_bytes = 0;
+const size_t kAllocationHeader = alignof(std::max_align_t); // keeps the size, so deletes can subtract it
+
+void* operator new(std::size_t size) {
+    ++allocations;
+    if (char* pointer = static_cast<char*>(std::malloc(size + kAllocationHeader))) {
+        *reinterpret_cast<std::size_t*>(pointer) = size;
+        live_bytes += size;
+        return pointer + kAllocationHeader;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* pointer) noexcept {
+    if (pointer == nullptr)
+        return;
+    char* start = static_cast<char*>(pointer) - kAllocationHeader;
+    live_bytes -= *reinterpret_cast<std::size_t*>(start);
+    std::free(start);
+}
+
+void operator delete(void* pointer, std::size_t) noexcept {
+    operator delete(pointer);
+}
+
+const std::chrono::milliseconds kMinBenchmarkTime(200);
+const std::string kCity = "london";
+
+// Runs `function` in growing batches until a batch takes kMinBenchmarkTime, reports the last batch
+template <typename Function>
+json Run(const std::string& name, Function function) {
+    function(); // warm up caches and lazy initialization
+    for (uint64_t iterations = 1;; iterations *= 2) {
+        uint64_t allocations_before = allocations;
+        auto start = std::chrono::steady_clock::now();
+        for (uint64_t i = 0; i < iterations; ++i)
+            function();
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        if (elapsed < kMinBenchmarkTime && iterations < (1ull << 30))
+            continue;
+        double ns = std::chrono::duration<double, std::nano>(elapsed).count();
+        json result = {
+            {"name", name},
+            {"iterations", iterations},
+            {"ns_per_op", ns / iterations},
+            {"allocs_per_op", double(allocations - allocations_before) / iterations}
+        };
+        std::cout << result.dump() << std::endl;
+        return result;
+    }
+}
+
+// Heap bytes still held by what `build` returns, plus the object itself
+template <typename Build>
+void Memory(const std::string& name, size_t days, Build build) {
+    int64_t before = live_bytes;
+    auto kept = build();
+    int64_t bytes = live_bytes - before + sizeof(kept);
+    json result = {{"name", name}, {"bytes", bytes}, {"bytes_per_city_day", double(bytes) / days}};
+    std::cout << result.dump() << std::endl;
+}
+
+std::filesystem::path WriteConfig(size_t num_cities) {
+    json config = {{"days", 3}, {"cities", json::array()}};
+    for (size_t i = 0; i < num_cities; ++i)
+        config["cities"].push_back("City " + std::to_string(i));
+    std::filesystem::path path = std::filesystem::temp_directory_path() / ("forecast_bench_" + std::to_string(num_cities) + ".json");
+    std::ofstream(path) << config.dump();
+    return path;
+}
+
+int main() {
+    std::optional<double> frame_budget;
+    if (const char* budget = std::getenv("FORECAST_FRAME_ALLOCATION_BUDGET"))
+        frame_budget = std::stod(budget);
+    bool over_budget = false;
+
+    Weather weather;
+    weather.SetTransport(std::make_shared<ReplayTransport>(FORECAST_FIXTURES));
+
+    // Fetch: replayed forecast request plus parsing, the coordinates stay cached after the first call
+    weather.SetCacheTTL(std::chrono::seconds(0));
+    Run("fetch/replay", [&] {
+        weather.Fetch(kCity);
+    });
+    // The daily aggregates the dashboard and the prefetches download instead of the hours
+    Run("fetch/overview", [&] {
+        weather.FetchMany({kCity}, Priority::Background, View::Overview);
+    });
+    weather.SetCacheTTL(kDefaultCacheTTL);
+
+    std::ifstream file(std::filesystem::path(FORECAST_FIXTURES) / RecordingName({ForecastDataUrl,
+        {{"latitude", "51.5072"}, {"longitude", "-0.1276"}, {"forecast_days", std::to_string(kMaxDays)},
+         {"hourly", "temperature_2m,relativehumidity_2m,apparent_temperature,weathercode,windspeed_10m"},
+         {"timezone", "auto"}, {"daily", "weathercode"}}, {}}));
+    std::string text = json::parse(file).at("text");
+    std::ifstream overview_file(std::filesystem::path(FORECAST_FIXTURES) / RecordingName({ForecastDataUrl,
+        {{"latitude", "51.5072"}, {"longitude", "-0.1276"}, {"forecast_days", std::to_string(kMaxDays)},
+         {"daily", "weather_code,temperature_2m_max,temperature_2m_min,apparent_temperature_max,"
+                   "apparent_temperature_min,wind_speed_10m_max,relative_humidity_2m_mean"},
+         {"current", "temperature_2m,relative_humidity_2m,weather_code,wind_speed_10m"},
+         {"timezone", "auto"}}, {}}));
+    std::string overview = json::parse(overview_file).at("text");
+
+    Run("parse/dom", [&] {
+        ForecastData::FromJson(json::parse(text));
+    });
+    Run("parse/sax", [&] {
+        ForecastParser::Parse(text);
+    });
+    Run("parse/overview", [&] {
+        ForecastParser::ValidateDaily(ForecastParser::ParseMany(overview).front());
+    });
+
+    // What a resident forecast costs: the json DOM of the response against the quantized block
+    Memory("memory/dom", kMaxDays, [&] {
+        return json::parse(text);
+    });
+    Memory("memory/compact", kMaxDays, [&] {
+        return ForecastParser::Parse(text);
+    });
+
+    ForecastData forecast = weather.ParseWeather(kCity, kMaxDays);
+    Run("aggregate/16_days", [&] {
+        forecast.Summarize();
+    });
+
+    // Response bytes per city: the hours for the table against the overview for everything else
+    for (const auto& [name, payload] : {std::pair<std::string, const std::string*>{"payload/detail", &text},
+                                        std::pair<std::string, const std::string*>{"payload/overview", &overview}}) {
+        json result = {{"name", name}, {"bytes", payload->size()}, {"bytes_per_city_day", double(payload->size()) / kMaxDays}};
+        std::cout << result.dump() << std::endl;
+    }
+
+    // One dashboard line, computed from the stored overview on a worker thread in the UI
+    ForecastSnapshot snapshot;
+    snapshot.fetched_at_ = snapshot.daily_fetched_at_ = std::chrono::system_clock::now();
+    snapshot.generation_ = 1;
+    snapshot.daily_ = ForecastParser::ValidateDaily(ForecastParser::ParseMany(overview).front());
+    Run("dashboard/row", [&] {
+        Dashboard::Summarize(snapshot, kMaxDays);
+    });
+
+    Console console;
+    Run("extract/16_days", [&] {
+        for (uint8_t day = 0; day < forecast.Days(); ++day) {
+            for (uint8_t part = 0; part < kDayParts; ++part) {
+                console.GetWeatherCode(forecast, day, static_cast<DayPart>(part));
+                console.GetDescription(forecast, day, static_cast<DayPart>(part));
+            }
+        }
+    });
+
+    for (uint8_t days = kMinDays; days <= kMaxDays; ++days) {
+        ForecastData sliced = forecast.Slice(days);
+        // A whole frame: building the table and drawing it
+        json result = Run("table/" + std::to_string(days) + "_days", [&] {
+            Element table = console.BuildTable(kCity, sliced);
+            Screen screen = Screen::Create(Dimension::Fixed(kBoxSize * kDayParts), Dimension::Fit(table));
+            Render(screen, table);
+        });
+        if (frame_budget && result["allocs_per_op"].get<double>() > *frame_budget) {
+            std::cerr << result["name"].get<std::string>() << ": " << result["allocs_per_op"].get<double>()
+                      << " allocations per frame, the budget is " << *frame_budget << '\n';
+            over_budget = true;
+        }
+    }
+
+    // `+` and `-` on a 16 day view, the day windows stay memoized between the two horizons
+    DayRows rows;
+    size_t horizon = kMaxDays;
+    Run("horizon/16_days", [&] {
+        horizon = horizon == kMaxDays ? kMaxDays - 1 : kMaxDays;
+        console.BuildTable(kCity, forecast, horizon, 0, kMaxDays, &rows);
+    });
+
+    for (size_t num_cities : {1000, 10000, 100000}) {
+        std::filesystem::path path = WriteConfig(num_cities);
+        Run("config/" + std::to_string(num_cities) + "_cities", [&] {
+            ConfigParser parser(path);
+            parser.Parse();
+        });
+        ConfigParser parser(path);
+        parser.Parse();
+        Config config = parser.GetConfig();
+        // A prefix, a substring and a fuzzy query, the last two scan the whole index
+        for (std::string query : {"city 12", "y 99", "cty9z"}) {
+            Run("search/" + std::to_string(num_cities) + "_cities/" + query, [&] {
+                config.city_index_->Search(query, kSearchResults);
+            });
+        }
+        std::filesystem::remove(path);
+    }
+    return over_budget ? 1 : 0;
+}
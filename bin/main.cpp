@@ -1,6 +1,20 @@
+#include "lib/AllocationHook.hpp"
 #include "lib/Forecast.hpp"
 
-int main() {
+int main(int argc, char* argv[]) {
     Forecast forecast;
-    forecast.Start();
+    if (argc > 1) {
+        try {
+            return forecast.Export(ExportOptions::FromArguments(argc, argv));
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << '\n' << kExportUsage;
+            return 1;
+        }
+    }
+    try {
+        forecast.Start();
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << '\n';
+        return 1;
+    }
 }
@@ -1,25 +1,57 @@
 #pragma once
 
-#include <cpr/cpr.h>
+#include "Transport.hpp"
+
 #include <string>
+#include <utility>
+#include <vector>
 
-using cpr::Get;
-using cpr::Parameters;
-using cpr::Url;
-using cpr::Header;
+const std::string CityDataUrl = "https://api.api-ninjas.com/v1/city";
+const std::string ForecastDataUrl = "https://api.open-meteo.com/v1/forecast";
 
-const std::string CityData = "https://api.api-ninjas.com/v1/city";
-const std::string ForecastData = "https://api.open-meteo.com/v1/forecast";
+// What a forecast request is for. The overview (dashboard, background prefetch) needs a handful of
+// daily aggregates and the current conditions, about 120 values per location at 16 days,
+// the day table needs five hourly variables, 1920 values.
+enum class View : uint8_t { Overview, Detail };
 
-cpr::Response GetCoordinates(const std::string& city, const std::string& api_key) {
-    return Get(Url{CityData},
-            Parameters{{"name", city}},
-            Header{{"X-Api-Key", api_key}});
+HttpResponse GetCoordinates(Transport& transport, const std::string& city, const std::string& api_key,
+                            Priority priority = Priority::Background) {
+    return transport.Get({CityDataUrl,
+            {{"name", city}},
+            {{"X-Api-Key", api_key}},
+            priority});
 }
 
-cpr::Response GetForecast(const std::string& latitude, const std::string& longitude, const std::string& num_days) {
-    return Get(Url{ForecastData},
-            Parameters{{"latitude", latitude}, {"longitude", longitude}, {"forecast_days", num_days},
+HttpResponse GetForecast(Transport& transport, const std::string& latitude, const std::string& longitude, const std::string& num_days,
+                         Priority priority = Priority::Background, View view = View::Detail) {
+    if (view == View::Overview) {
+        return transport.Get({ForecastDataUrl,
+                {{"latitude", latitude}, {"longitude", longitude}, {"forecast_days", num_days},
+                            {"daily", "weather_code,temperature_2m_max,temperature_2m_min,apparent_temperature_max,"
+                                      "apparent_temperature_min,wind_speed_10m_max,relative_humidity_2m_mean"},
+                            {"current", "temperature_2m,relative_humidity_2m,weather_code,wind_speed_10m"},
+                            {"timezone", "auto"}},
+                {},
+                priority});
+    }
+    // All days from today, not only the ones on screen: the table scrolls through the whole horizon and
+    // `+` grows it without a request, and a snapshot holds one block of hours starting at day 0
+    return transport.Get({ForecastDataUrl,
+            {{"latitude", latitude}, {"longitude", longitude}, {"forecast_days", num_days},
                         {"hourly", "temperature_2m,relativehumidity_2m,apparent_temperature,weathercode,windspeed_10m"},
-                        {"timezone", "auto"}, {"daily", "weathercode"}});
+                        {"timezone", "auto"}, {"daily", "weathercode"}},
+            {},
+            priority});
+}
+
+// Forecasts for several (latitude, longitude) pairs in one request, the response is an array in the same order
+HttpResponse GetForecasts(Transport& transport, const std::vector<std::pair<std::string, std::string>>& locations, const std::string& num_days,
+                          Priority priority = Priority::Background, View view = View::Detail) {
+    std::string latitudes;
+    std::string longitudes;
+    for (const auto& [latitude, longitude] : locations) {
+        latitudes += (latitudes.empty() ? "" : ",") + latitude;
+        longitudes += (longitudes.empty() ? "" : ",") + longitude;
+    }
+    return GetForecast(transport, latitudes, longitudes, num_days, priority, view);
 }
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+const uint8_t kHoursPerDay = 24;
+
+const uint8_t kStartOfNight = 0;
+const uint8_t kEndOfNight = 5;
+
+const uint8_t kStartOfMorning = 6;
+const uint8_t kEndOfMorning = 12;
+
+const uint8_t kStartOfAfternoon = 13;
+const uint8_t kEndOfAfternoon = 18;
+
+const uint8_t kStartOfEvening = 19;
+const uint8_t kEndOfEvening = 23;
+
+// Same order as the day parts are shown in
+enum class DayPart : uint8_t { Morning, Noon, Evening, Night };
+const uint8_t kDayParts = 4;
+const char* const kDayPartNames[kDayParts] = {"Morning", "Noon", "Evening", "Night"};
+
+// First and last hour of every day part, both inclusive
+const std::pair<uint8_t, uint8_t> kDayPartHours[kDayParts] = {
+    {kStartOfMorning, kEndOfMorning},
+    {kStartOfAfternoon, kEndOfAfternoon},
+    {kStartOfEvening, kEndOfEvening},
+    {kStartOfNight, kEndOfNight}
+};
+
+enum class Variable : uint8_t { Temperature, ApparentTemperature, Windspeed, Humidity };
+const uint8_t kVariables = 4;
+
+struct Summary
+{
+    float min_;
+    float mean_;
+    float max_;
+};
+
+// Summaries of every (day, day part, variable), laid out day by day
+class DayPartSummaries
+{
+private:
+    std::vector<Summary> summaries_;
+
+public:
+    DayPartSummaries() {}
+
+    explicit DayPartSummaries(size_t days)
+        : summaries_(days * kDayParts * kVariables)
+    {}
+
+    size_t Days() const {
+        return summaries_.size() / (kDayParts * kVariables);
+    }
+
+    const Summary& Get(size_t day, DayPart part, Variable variable) const {
+        return summaries_[Index(day, part, variable)];
+    }
+
+    // Computes min, mean and max over all hours of each day part of one hourly column in a single pass.
+    // Values are multiplied by `scale`, `missing` hours are left out of all three, a day part without
+    // any value gets NaN. The inner loop is branchless over a contiguous range, so the compiler can vectorize it.
+    template <typename T>
+    void Aggregate(const T* column, size_t size, Variable variable, T missing, float scale) {
+        const float nan = std::numeric_limits<float>::quiet_NaN();
+        size_t days = std::min(Days(), size / kHoursPerDay);
+        for (size_t day = 0; day < days; ++day) {
+            const T* hours = column + day * kHoursPerDay;
+            for (uint8_t part = 0; part < kDayParts; ++part) {
+                auto [begin, end] = kDayPartHours[part];
+                float min = std::numeric_limits<float>::infinity();
+                float max = -std::numeric_limits<float>::infinity();
+                float sum = 0;
+                uint8_t count = 0;
+                for (uint8_t hour = begin; hour <= end; ++hour) {
+                    bool present = hours[hour] != missing;
+                    float value = hours[hour] * scale;
+                    min = present && value < min ? value : min;
+                    max = present && value > max ? value : max;
+                    sum += present ? value : 0;
+                    count += present;
+                }
+                summaries_[Index(day, static_cast<DayPart>(part), variable)] =
+                    count > 0 ? Summary{min, sum / count, max} : Summary{nan, nan, nan};
+            }
+        }
+    }
+
+    size_t MemoryUsage() const {
+        return summaries_.capacity() * sizeof(Summary);
+    }
+
+    // Copy holding only the first `days` days
+    DayPartSummaries Slice(size_t days) const {
+        DayPartSummaries result;
+        days = std::min(days, Days());
+        result.summaries_.assign(summaries_.begin(), summaries_.begin() + days * kDayParts * kVariables);
+        return result;
+    }
+
+private:
+    static size_t Index(size_t day, DayPart part, Variable variable) {
+        return (day * kDayParts + static_cast<uint8_t>(part)) * kVariables + static_cast<uint8_t>(variable);
+    }
+};
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "Stats.hpp"
+
+#include <cstdlib>
+#include <new>
+
+// Replaces the global operator new so Counter::Allocations counts heap allocations once statistics are enabled.
+// Defines the operators, so it has to be included by exactly one translation unit of the executable.
+
+void* operator new(std::size_t size) {
+    Stats::Add(Counter::Allocations);
+    if (void* pointer = std::malloc(size == 0 ? 1 : size))
+        return pointer;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* pointer) noexcept {
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, std::size_t) noexcept {
+    std::free(pointer);
+}
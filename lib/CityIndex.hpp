@@ -0,0 +1,122 @@
+#pragma once
+
+#include "CityKey.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Search over the configured cities, built once when the config is loaded.
+// Names and their CityKeys are interned into two shared buffers, so an entry costs a few
+// integers instead of two heap strings. Ids are positions in Config::cities_.
+class CityIndex
+{
+private:
+    struct Entry {
+        uint32_t name_begin_;
+        uint32_t name_length_;
+        uint32_t key_begin_;
+        uint32_t key_length_;
+        uint64_t symbols_; // bit per symbol class present in the key, see SymbolMask
+    };
+
+    std::string names_;
+    std::string keys_;
+    std::vector<Entry> entries_;
+    std::vector<uint32_t> sorted_; // ids ordered by key, for prefix lookups
+
+public:
+    CityIndex() {}
+
+    explicit CityIndex(const std::vector<std::string>& cities) {
+        entries_.reserve(cities.size());
+        for (const auto& city : cities) {
+            std::string key = CityKey(city);
+            entries_.push_back({static_cast<uint32_t>(names_.size()), static_cast<uint32_t>(city.size()),
+                                static_cast<uint32_t>(keys_.size()), static_cast<uint32_t>(key.size()),
+                                SymbolMask(key)});
+            names_ += city;
+            keys_ += key;
+        }
+        sorted_.resize(entries_.size());
+        for (uint32_t id = 0; id < sorted_.size(); ++id)
+            sorted_[id] = id;
+        std::sort(sorted_.begin(), sorted_.end(), [this](uint32_t lhs, uint32_t rhs) {
+            return Key(lhs) < Key(rhs);
+        });
+    }
+
+    size_t Size() const {
+        return entries_.size();
+    }
+
+    std::string_view Name(uint32_t id) const {
+        return std::string_view(names_).substr(entries_[id].name_begin_, entries_[id].name_length_);
+    }
+
+    // Up to `limit` ids matching the query: names starting with it in alphabetical order first,
+    // then names containing it, then names containing its letters in order ("nwyrk" finds "New York")
+    std::vector<uint32_t> Search(std::string_view query, size_t limit) const {
+        std::vector<uint32_t> found;
+        std::string key = CityKey(query);
+        if (key.empty() || limit == 0)
+            return found;
+
+        auto prefix = std::lower_bound(sorted_.begin(), sorted_.end(), key, [this](uint32_t id, const std::string& key) {
+            return Key(id) < key;
+        });
+        for (; prefix != sorted_.end() && found.size() < limit && Key(*prefix).starts_with(key); ++prefix)
+            found.push_back(*prefix);
+        if (found.size() == limit)
+            return found;
+
+        // A linear pass for the rest, the symbol masks reject most entries without reading the key
+        std::vector<uint32_t> fuzzy;
+        uint64_t symbols = SymbolMask(key);
+        for (uint32_t id = 0; id < entries_.size() && found.size() < limit; ++id) {
+            if ((entries_[id].symbols_ & symbols) != symbols)
+                continue;
+            std::string_view candidate = Key(id);
+            size_t position = candidate.find(key);
+            if (position != std::string_view::npos) {
+                if (position != 0)
+                    found.push_back(id);
+            } else if (fuzzy.size() < limit && IsSubsequence(key, candidate)) {
+                fuzzy.push_back(id);
+            }
+        }
+        for (size_t i = 0; i < fuzzy.size() && found.size() < limit; ++i)
+            found.push_back(fuzzy[i]);
+        return found;
+    }
+
+private:
+    std::string_view Key(uint32_t id) const {
+        return std::string_view(keys_).substr(entries_[id].key_begin_, entries_[id].key_length_);
+    }
+
+    // Letters and digits get a bit each, every other byte (UTF-8 included) shares the rest by value
+    static uint64_t SymbolMask(std::string_view key) {
+        uint64_t mask = 0;
+        for (unsigned char symbol : key) {
+            if (symbol >= 'a' && symbol <= 'z')
+                mask |= 1ull << (symbol - 'a');
+            else if (symbol >= '0' && symbol <= '9')
+                mask |= 1ull << (26 + symbol - '0');
+            else
+                mask |= 1ull << (36 + symbol % 28);
+        }
+        return mask;
+    }
+
+    static bool IsSubsequence(std::string_view query, std::string_view text) {
+        size_t matched = 0;
+        for (size_t i = 0; i < text.size() && matched < query.size(); ++i) {
+            if (text[i] == query[matched])
+                ++matched;
+        }
+        return matched == query.size();
+    }
+};
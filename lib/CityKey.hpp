@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Canonical form of a city name used as cache key, so "London", "london " and "LONDON"
+// share one entry. Whitespace is trimmed and collapsed (Unicode spaces included) and letters
+// are case-folded: ASCII, Latin-1 and Cyrillic, which covers the names the APIs know.
+// Decomposed sequences (a letter followed by a combining accent) are not recomposed,
+// that would need the Unicode tables of a library like ICU.
+inline std::string CityKey(std::string_view city) {
+    std::string key;
+    key.reserve(city.size());
+    bool pending_space = false;
+
+    for (size_t i = 0; i < city.size();) {
+        unsigned char byte = city[i];
+        // Decode one UTF-8 code point, invalid bytes are kept as they are
+        uint32_t code_point = byte;
+        size_t length = 1;
+        if (byte >= 0xC0 && byte < 0xE0 && i + 1 < city.size()) {
+            code_point = ((byte & 0x1F) << 6) | (city[i + 1] & 0x3F);
+            length = 2;
+        } else if (byte >= 0xE0 && byte < 0xF0 && i + 2 < city.size()) {
+            code_point = ((byte & 0x0F) << 12) | ((city[i + 1] & 0x3F) << 6) | (city[i + 2] & 0x3F);
+            length = 3;
+        }
+
+        bool is_space = code_point == ' ' || (code_point >= '\t' && code_point <= '\r') || code_point == 0xA0
+                        || (code_point >= 0x2000 && code_point <= 0x200A) || code_point == 0x202F
+                        || code_point == 0x205F || code_point == 0x3000;
+        if (is_space) {
+            pending_space = !key.empty();
+            i += length;
+            continue;
+        }
+        if (pending_space) {
+            key += ' ';
+            pending_space = false;
+        }
+
+        if (code_point >= 'A' && code_point <= 'Z')
+            code_point += 'a' - 'A';
+        else if (code_point >= 0xC0 && code_point <= 0xDE && code_point != 0xD7) // Latin-1 À..Þ
+            code_point += 0x20;
+        else if (code_point >= 0x410 && code_point <= 0x42F) // Cyrillic А..Я
+            code_point += 0x20;
+        else if (code_point >= 0x400 && code_point <= 0x40F) // Cyrillic Ѐ..Џ, Ё included
+            code_point += 0x50;
+
+        if (length == 1) {
+            key += static_cast<char>(code_point < 0x80 ? code_point : byte);
+        } else if (code_point < 0x800) {
+            key += static_cast<char>(0xC0 | (code_point >> 6));
+            key += static_cast<char>(0x80 | (code_point & 0x3F));
+        } else {
+            key += static_cast<char>(0xE0 | (code_point >> 12));
+            key += static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+            key += static_cast<char>(0x80 | (code_point & 0x3F));
+        }
+        i += length;
+    }
+    return key;
+}
@@ -1,32 +1,60 @@
 #pragma once
 
 #include <algorithm>
+#include <chrono>
 #include <string>
 #include <vector>
 #include <fstream>
 #include <filesystem>
+#include <memory>
 #include <nlohmann/json.hpp>
+#include <stdexcept>
+
+#include "CityIndex.hpp"
 
 using json = nlohmann::json;
 
+const uint8_t kMinDays = 1;
+const uint8_t kMaxDays = 16; // the longest forecast Open-Meteo gives
+const std::chrono::seconds kDefaultCacheTTL{3600};
+const std::string kDefaultCacheFile = "forecast_cache.bin";
+
+// The cfg.json next to the sources, used when no other config is given
+inline std::filesystem::path DefaultConfigPath() {
+    return std::filesystem::path(__FILE__).remove_filename() / "cfg.json";
+}
+
 struct Config
 {
     std::vector<std::string> cities_;
-    uint8_t num_days_;
+    std::shared_ptr<const CityIndex> city_index_; // over cities_, shared by the copies of the config
+    uint8_t num_days_ = 0;
+    std::chrono::seconds cache_ttl_ = kDefaultCacheTTL;
+    std::filesystem::path cache_path_;
+    std::filesystem::path stats_path_; // empty - statistics aren't collected from the start nor saved
 };
 
+// Reads the config with a streaming (SAX) parser, the city list goes straight into
+// Config::cities_ without a json DOM of the whole file in between
 class ConfigParser
 {
 private:
+    enum class Field {Other, Cities, Days, CacheTTL, CachePath, StatsPath};
+
     Config config_;
-    json data_;
+    std::filesystem::path path_;
     std::ifstream file_;
+    int depth_ = 0;
+    Field field_ = Field::Other;
+    bool has_cities_ = false;
+    bool has_days_ = false;
 
 public:
     ConfigParser() {}
 
     ConfigParser(const std::filesystem::path& path) 
-        : file_(path) 
+        : path_(path)
+        , file_(path)
     {}
 
     ~ConfigParser() {
@@ -34,16 +62,129 @@ public:
     }
 
     void Parse() {
-        try {
-            data_ = json::parse(file_);
-        } catch (...) {
+        config_ = Config();
+        // Relative cache paths are relative to the config file
+        config_.cache_path_ = path_.parent_path() / kDefaultCacheFile;
+        depth_ = 0;
+        has_cities_ = has_days_ = false;
+        if (!json::sax_parse(file_, this) || !has_cities_ || !has_days_)
             throw std::invalid_argument("Parsing config file failed.");
-        }
-        config_.cities_ = data_["cities"].get<std::vector<std::string>>();
-        config_.num_days_ = data_["days"].get<uint8_t>();
+        if (config_.cities_.empty())
+            throw std::invalid_argument("The config has no cities.");
+        if (config_.num_days_ < kMinDays || config_.num_days_ > kMaxDays)
+            throw std::invalid_argument("\"days\" in the config must be from " + std::to_string(kMinDays) + " to "
+                                        + std::to_string(kMaxDays) + ".");
+        if (config_.cache_ttl_.count() <= 0)
+            throw std::invalid_argument("\"cache_ttl\" in the config must be a positive number of seconds.");
+        config_.city_index_ = std::make_shared<const CityIndex>(config_.cities_);
     }
 
     Config GetConfig() const {
         return config_;
     }
+
+    bool key(std::string& key) {
+        if (depth_ != 1)
+            return true;
+        if (key == "cities")
+            field_ = Field::Cities;
+        else if (key == "days")
+            field_ = Field::Days;
+        else if (key == "cache_ttl")
+            field_ = Field::CacheTTL;
+        else if (key == "cache_path")
+            field_ = Field::CachePath;
+        else if (key == "stats_path")
+            field_ = Field::StatsPath;
+        else
+            field_ = Field::Other;
+        return true;
+    }
+
+    bool null() {
+        return depth_ != 1 || field_ == Field::Other;
+    }
+
+    bool boolean(bool) {
+        return depth_ != 1 || field_ == Field::Other;
+    }
+
+    bool number_integer(json::number_integer_t value) {
+        return Number(value);
+    }
+
+    bool number_unsigned(json::number_unsigned_t value) {
+        return Number(static_cast<int64_t>(value));
+    }
+
+    bool number_float(json::number_float_t, const std::string&) {
+        return depth_ != 1 || field_ == Field::Other;
+    }
+
+    bool string(std::string& value) {
+        if (depth_ == 2 && field_ == Field::Cities) {
+            config_.cities_.push_back(std::move(value));
+            return true;
+        }
+        if (depth_ != 1)
+            return true;
+        if (field_ == Field::CachePath)
+            config_.cache_path_ = path_.parent_path() / value;
+        else if (field_ == Field::StatsPath)
+            config_.stats_path_ = path_.parent_path() / value;
+        else if (field_ != Field::Other)
+            return false;
+        return true;
+    }
+
+    bool binary(json::binary_t&) {
+        return true;
+    }
+
+    bool start_object(size_t) {
+        ++depth_;
+        return depth_ == 1 || field_ != Field::Cities;
+    }
+
+    bool end_object() {
+        --depth_;
+        return true;
+    }
+
+    bool start_array(size_t) {
+        if (depth_ == 0)
+            return false;
+        if (depth_ == 1 && field_ == Field::Cities)
+            has_cities_ = true;
+        else if (depth_ == 1 && field_ != Field::Other)
+            return false;
+        ++depth_;
+        return depth_ <= 2 || field_ != Field::Cities;
+    }
+
+    bool end_array() {
+        --depth_;
+        return true;
+    }
+
+    bool parse_error(size_t, const std::string&, const nlohmann::detail::exception&) {
+        return false;
+    }
+
+private:
+    bool Number(int64_t value) {
+        if (depth_ != 1)
+            return depth_ != 2 || field_ != Field::Cities;
+        if (field_ == Field::Days) {
+            if (value < 0 || value > UINT8_MAX)
+                return false;
+            config_.num_days_ = static_cast<uint8_t>(value);
+            has_days_ = true;
+        } else if (field_ == Field::CacheTTL) {
+            config_.cache_ttl_ = std::chrono::seconds(value);
+        } else if (field_ != Field::Other) {
+            return false;
+        }
+        return true;
+    }
 };
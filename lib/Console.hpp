@@ -1,46 +1,150 @@
 #pragma once
 
-#include <functional>
-#include "Weather.hpp"
+#include <array>
+#include <charconv>
+#include <condition_variable>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+#include "Dashboard.hpp"
+#include "Fetcher.hpp"
+#include "WeatherCodes.hpp"
 
 #include "ftxui/component/captured_mouse.hpp"
 #include "ftxui/component/component.hpp"
 #include "ftxui/component/screen_interactive.hpp"
 #include "ftxui/dom/elements.hpp"
+#include "ftxui/dom/node.hpp"
 #include "ftxui/component/event.hpp"
-#include "ftxui/component/loop.hpp"
 #include "ftxui/dom/table.hpp"
+#include "ftxui/screen/terminal.hpp"
 
 using namespace ftxui;
 
-const uint8_t kMinDays = 1;
-const uint8_t kMaxDays = 16;
-const uint8_t kHoursPerDay = 24;
+#if defined(_WIN32) && !defined(ENABLE_VIRTUAL_TERMINAL_PROCESSING)
+#define ENABLE_VIRTUAL_TERMINAL_PROCESSING 0x0004 // missing from SDKs older than Windows 10
+#endif
+
 const uint8_t kInfoOfDay = 4;
 const uint8_t kBoxSize = 80;
 const uint8_t kSmallBoxSize = 25;
-const uint8_t kUnknownCode = 145;
+const uint8_t kSpriteHeight = 8; // the tallest sprite, every day part box gets this height
+const uint8_t kDayRowHeight = kSpriteHeight + 6; // part name, separator and two borders around it
+const uint8_t kMaxTableHeight = 50;
+const uint8_t kTableChrome = 5; // outer border, age, title and scroll position lines
+const uint8_t kOverscanDays = 1; // built past the viewport, so a partly visible last day is drawn
+const uint8_t kSearchResults = 10;
+const uint8_t kNumberBuffer = 16; // a number and its unit, fits the small string optimization
+const uint8_t kRowCacheCities = 8; // cities whose day windows are kept, the least recently shown ones go first
+const uint8_t kDashboardChrome = 5; // outer border, title, column names and separator
+const uint8_t kCityColumn = 24;
+const uint8_t kConditionColumn = 22;
+const uint8_t kValueColumn = 10;
+const uint8_t kRangeColumn = 12;
+const char* const kDashboardDayNames[kDashboardDays] = {"Today", "Tomorrow", "+2", "+3"};
+
+// Calls `redraw` at a given moment from its own thread, for what changes on screen with time alone
+class RedrawTimer
+{
+private:
+    std::function<void()> redraw_;
+    std::optional<std::chrono::system_clock::time_point> at_;
+    std::mutex mutex_;
+    std::condition_variable changed_;
+    bool stopping_ = false;
+    std::thread thread_;
+
+public:
+    explicit RedrawTimer(std::function<void()> redraw)
+        : redraw_(std::move(redraw))
+        , thread_([this] { Run(); })
+    {}
+
+    ~RedrawTimer() {
+        {
+            std::lock_guard lock(mutex_);
+            stopping_ = true;
+        }
+        changed_.notify_one();
+        thread_.join();
+    }
+
+    // Replaces the moment of the next redraw
+    void At(std::chrono::system_clock::time_point at) {
+        {
+            std::lock_guard lock(mutex_);
+            if (at_ == at)
+                return;
+            at_ = at;
+        }
+        changed_.notify_one();
+    }
+
+private:
+    void Run() {
+        std::unique_lock lock(mutex_);
+        while (!stopping_) {
+            if (!at_) {
+                changed_.wait(lock);
+            } else if (std::chrono::system_clock::now() < *at_) {
+                changed_.wait_until(lock, *at_);
+            } else {
+                at_.reset();
+                lock.unlock();
+                redraw_();
+                lock.lock();
+            }
+        }
+    }
+};
 
-const uint8_t kStartOfNight = 0;
-const uint8_t kEndOfNight = 5;
+// Records FTXUI's layout and render passes over the wrapped element into Stage::Render: from the first
+// requirement computed, layouts may take several passes, until the element is drawn into the screen
+class RenderTimer : public Node
+{
+private:
+    std::optional<std::chrono::steady_clock::time_point> start_;
 
-const uint8_t kStartOfMorning = 6;
-const uint8_t kEndOfMorning = 12;
+public:
+    explicit RenderTimer(Element child)
+        : Node({std::move(child)})
+    {}
+
+    void ComputeRequirement() override {
+        if (!start_)
+            start_ = std::chrono::steady_clock::now();
+        children_[0]->ComputeRequirement();
+        requirement_ = children_[0]->requirement();
+    }
 
-const uint8_t kStartOfAfternoon = 13;
-const uint8_t kEndOfAfternoon = 18;
+    void SetBox(Box box) override {
+        Node::SetBox(box);
+        children_[0]->SetBox(box);
+    }
 
-const uint8_t kStartOfEvening = 19;
-const uint8_t kEndOfEvening = 23;
+    void Render(Screen& screen) override {
+        children_[0]->Render(screen);
+        if (start_)
+            Stats::Record(Stage::Render, std::chrono::steady_clock::now() - *start_);
+        start_.reset();
+    }
+};
 
-const std::vector<std::string> daytime = {"Morning", "Noon", "Evening", "Night"};
+// Day windows built for one city, valid while its forecast keeps the generation they were built from
+struct DayRows
+{
+    uint64_t generation_ = 0;
+    std::array<Element, kMaxDays> rows_;
+    uint64_t last_used_ = 0;
+};
 
 class Console 
 {
 private:
     Config cfg_;
-    std::unordered_map<uint8_t, std::string> names_;
-    std::unordered_map<uint8_t, std::function<std::vector<Element>()>> images_;
 
     const std::string text_0 = "This project is a simple weather forecast application, that allows users to get weather forecast for any city in the world based on the city's coordinates.";
     const std::string text_1 = "    How to use the application:";
@@ -52,18 +156,24 @@ private:
     const std::string text_7 = "`-` : Decrease the number of forecasted days (down to a minimum limit).";
     const std::string text_8 = "`n` : Move to the next city.";
     const std::string text_9 = "`p` : Move to the previous city.";
+    const std::string text_11 = "`s` : Show or hide request and render statistics.";
+    const std::string text_12 = "Arrows, `PgUp`/`PgDn`, `Home`/`End` or the mouse wheel : Scroll through the days.";
+    const std::string text_13 = "`/` : Search for a city by name and jump to it with `Enter`.";
+    const std::string text_14 = "`d` : Show or hide the dashboard with a line per city.";
     const std::string text_10 = "`Esc` : Exit the application";
 
 
-    std::pair<std::string, std::string> data = {"", std::filesystem::path(__FILE__).remove_filename().string() += "cfg.json"}; // first - API, second - config path
+    std::pair<std::string, std::string> data = {"", DefaultConfigPath().string()}; // first - API, second - config path
     int has_error = 0; // 0 - no error, 1 - empty api key, 2 - invalid config path
 
+    std::unordered_map<std::string, DayRows> day_rows_; // of the last kRowCacheCities cities shown
+    uint64_t day_rows_uses_ = 0;
+
 public:
-    Console() {
-        FillMaps();
-    }
+    Console() {}
 
-    std::pair<std::string, std::string> GetUserInfo() {
+    // Empty if the user chose to exit
+    std::optional<std::pair<std::string, std::string>> GetUserInfo() {
         ClearScreen();
         auto screen = ScreenInteractive::TerminalOutput();
         // Search Engine Title
@@ -85,10 +195,14 @@ public:
                             text(text_7) | color(Color::DarkSeaGreen3),
                             text(text_8) | color(Color::DarkSeaGreen3),
                             text(text_9) | color(Color::DarkSeaGreen3),
+                            text(text_11) | color(Color::DarkSeaGreen3),
+                            text(text_12) | color(Color::DarkSeaGreen3),
+                            text(text_13) | color(Color::DarkSeaGreen3),
+                            text(text_14) | color(Color::DarkSeaGreen3),
                             text(text_10) | color(Color::DarkSeaGreen3),
                           })
                           ) | color(Color::DarkSeaGreen1)
-                            | size(HEIGHT, EQUAL, 12);
+                            | size(HEIGHT, EQUAL, 16);
         });
         // API key Input
         std::string api_key = "";
@@ -167,16 +281,16 @@ public:
         screen.Loop(component);
         // Check if the user wants to quit
         if (exit_is_active)
-            exit(0);
+            return std::nullopt;
         // Check if the api key has been entered
         if (api_key.empty()) {
             has_error = 1;
             ClearScreen();
-            data = GetUserInfo(); // Inform user and try again
+            return GetUserInfo(); // Inform user and try again
         } else if (!config_path.empty() && !CheckFile(config_path)) {
             has_error = 2;
             ClearScreen();
-            data = GetUserInfo(); // Inform user and try again
+            return GetUserInfo(); // Inform user and try again
         } else if (!config_path.empty()) {
             has_error = 0;
             data = {api_key, config_path};
@@ -187,184 +301,526 @@ public:
         return data;
     }
 
-    void PrintResults(Weather& weather) {
+    // `started` is when the prompt was answered, the time until the first table is shown goes into the statistics
+    void PrintResults(Weather& weather, Fetcher& fetcher,
+                      std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now()) {
         ClearScreen();
         auto screen = ScreenInteractive::FitComponent();
         auto current_city = cfg_.cities_.begin();
+        // Summary lines of every city, filled in on worker threads as forecasts arrive
+        Dashboard dashboard(weather, cfg_.cities_, cfg_.num_days_, [&] {
+            screen.PostEvent(Event::Custom);
+        });
+        // Redraw whenever a download finishes
+        fetcher.SetOnUpdate([&](const std::vector<std::string>& cities) {
+            dashboard.Update(cities);
+            screen.PostEvent(Event::Custom);
+        });
+        // And when the age shown goes up a minute, the forecast expires or a failed one may be retried
+        RedrawTimer redraw_timer([&] {
+            screen.PostEvent(Event::Custom);
+        });
+        // Only the days in view are built, first_day is the one at the top
+        size_t first_day = 0;
+        size_t visible_days = 1;
+        // Last built table, reused while the city, the visible days and the data stay the same
+        Element table_cache;
+        std::string cached_city;
+        uint8_t cached_days = 0;
+        size_t cached_first_day = 0;
+        size_t cached_visible_days = 0;
+        uint64_t cached_generation = 0;
+        // Latest forecast of the current city, published by the downloads without locking the renderer out
+        std::shared_ptr<const ForecastSlot> slot;
+        std::string slot_city;
         // Main table
         auto table = Renderer([&] {
-            json forecast;
-            forecast = weather.ParseWeather(*current_city, cfg_.num_days_);
-            Elements windows;
-            windows.push_back(text("Weather forecast for: " + *current_city) | center | bold | color(Color::White));
-            
-            for (size_t day = 0; day < cfg_.num_days_; ++day) {
-            Elements row;
-            row.reserve(daytime.size());
-
-            for (const auto& time : daytime) {
-                row.push_back(vbox({text(time) | center | bold,
-                                    separator(),
-                                    hbox({
-                                    vbox(GetImage(GetWeatherCode(forecast, day, time))),
-                                    vbox(GetDescription(forecast, day, time)) | border | size(WIDTH, EQUAL, kSmallBoxSize)
-                                    })}) | border | size(WIDTH, EQUAL, kBoxSize));
+            int height = std::min<int>(Terminal::Size().dimy, kMaxTableHeight) - kTableChrome;
+            visible_days = std::max(1, height / kDayRowHeight);
+            first_day = std::min<size_t>(first_day, cfg_.num_days_ > visible_days ? cfg_.num_days_ - visible_days : 0);
+            if (!slot || slot_city != *current_city) {
+                slot = weather.Watch(*current_city);
+                slot_city = *current_city;
+                // Only the hours of the city on screen are kept fresh, the others download them when shown
+                fetcher.Focus({*current_city});
             }
-
-            windows.push_back(window(
-                text(forecast["daily"]["time"][day].get<std::string>()) | color(Color::DarkSeaGreen1) | center,
-                vbox(hbox(std::move(row)))));
+            std::shared_ptr<const ForecastSnapshot> snapshot = slot->load();
+            std::optional<std::string> error = fetcher.GetError(*current_city);
+            // A failed city is asked for again once its retry time has passed, the error stays until then
+            if ((!snapshot || !weather.IsFresh(*snapshot)) && fetcher.IsRetryDue(*current_city))
+                fetcher.Request(*current_city);
+            // The dashboard may have downloaded the overview only, the table needs the hours
+            if (!snapshot || !snapshot->Has(View::Detail)) {
+                if (error) {
+                    if (auto retry_at = fetcher.RetryAfter(*current_city))
+                        redraw_timer.At(*retry_at);
+                    return vbox({
+                        text("Weather forecast for: " + *current_city) | center | bold | color(Color::White),
+                        text("Error: " + *error) | bgcolor(Color::DarkSeaGreen3) | color(Color::Black) | xflex
+                    });
+                }
+                return vbox({
+                    text("Weather forecast for: " + *current_city) | center | bold | color(Color::White),
+                    text("Loading forecast...") | center | color(Color::DarkSeaGreen1)
+                });
+            }
+            if (!table_cache || cached_city != *current_city || cached_days != cfg_.num_days_
+                || cached_first_day != first_day || cached_visible_days != visible_days
+                || cached_generation != snapshot->generation_) {
+                StageTimer timer(Stage::Build);
+                // Day windows are kept per city, a new horizon or scroll position only builds the days not seen yet
+                DayRows& rows = GetDayRows(*current_city, snapshot->generation_);
+                table_cache = BuildTable(*current_city, snapshot->forecast_, cfg_.num_days_, first_day, visible_days, &rows);
+                Stats::SetFirstTable(std::chrono::steady_clock::now() - started);
+                cached_city = *current_city;
+                cached_days = cfg_.num_days_;
+                cached_first_day = first_day;
+                cached_visible_days = visible_days;
+                cached_generation = snapshot->generation_;
             }
-            return vbox(std::move(windows));
+            // The age changes without new data, so it stays out of the cached table
+            auto now = std::chrono::system_clock::now();
+            auto age = std::chrono::floor<std::chrono::minutes>(now - snapshot->fetched_at_);
+            auto redraw_at = snapshot->fetched_at_ + age + std::chrono::minutes(1);
+            if (auto expires_at = weather.ExpiresAt(*snapshot); expires_at > now)
+                redraw_at = std::min(redraw_at, expires_at);
+            if (auto retry_at = fetcher.RetryAfter(*current_city); retry_at && *retry_at > now)
+                redraw_at = std::min(redraw_at, *retry_at);
+            redraw_timer.At(redraw_at);
+            return vbox({GetAge(*snapshot, weather.IsFresh(*snapshot), error), table_cache});
         });
         // Layout
         auto layout = Container::Vertical({
             table
         });
+        // Dashboard, toggled with `d`. Only the lines in view are built, the selected one opens with `Enter`
+        bool show_dashboard = false;
+        size_t first_row = 0;
+        size_t selected_row = 0;
+        size_t visible_rows = 1;
+        auto dashboard_view = Renderer([&] {
+            dashboard.MarkDrawn();
+            dashboard.SetDays(cfg_.num_days_);
+            int height = std::min<int>(Terminal::Size().dimy, kMaxTableHeight) - kDashboardChrome;
+            visible_rows = std::max(1, height);
+            selected_row = std::min(selected_row, std::max<size_t>(dashboard.Size(), 1) - 1);
+            if (selected_row < first_row)
+                first_row = selected_row;
+            else if (selected_row >= first_row + visible_rows)
+                first_row = selected_row - visible_rows + 1;
+            return GetDashboard(dashboard, fetcher, first_row, visible_rows, selected_row);
+        });
         // Main render component
+        // Statistics overlay, toggled with `s`
+        bool show_stats = false;
+        // City search box, opened with `/`
+        bool searching = false;
+        std::string query;
+        std::vector<uint32_t> matches;
+        size_t selected = 0;
+        uint64_t allocations_seen = Stats::Get(Counter::Allocations);
         auto component = Renderer(layout, [&] {
-            return vbox({
-                    table->Render() | vscroll_indicator | yframe | size(HEIGHT, LESS_THAN, 50)
+            // Allocations since the previous frame: this layout plus drawing the last one and its events
+            uint64_t allocations = Stats::Get(Counter::Allocations);
+            Stats::RecordFrame(allocations - allocations_seen);
+            allocations_seen = allocations;
+            Element main = vbox({
+                    (show_dashboard ? dashboard_view->Render() : table->Render()) | yframe | size(HEIGHT, LESS_THAN, kMaxTableHeight)
                 }) | flex | border;
+            Elements layers = {main};
+            if (show_stats)
+                layers.push_back(GetStats() | clear_under | center);
+            if (searching)
+                layers.push_back(GetSearch(query, matches, selected) | clear_under | center);
+            return std::make_shared<RenderTimer>(layers.size() == 1 ? main : dbox(std::move(layers)));
         });
-        component = CatchEvent(component, [&](const Event& event) {
-            if (event == Event::Escape)
+        component = CatchEvent(component, [&](Event event) {
+            if (searching) {
+                if (event == Event::Escape) {
+                    searching = false;
+                } else if (event == Event::Return) {
+                    if (!matches.empty()) {
+                        current_city = cfg_.cities_.begin() + matches[selected];
+                        selected_row = matches[selected];
+                        first_day = 0;
+                    }
+                    searching = false;
+                } else if (event == Event::ArrowDown) {
+                    if (selected + 1 < matches.size()) selected++;
+                } else if (event == Event::ArrowUp) {
+                    if (selected > 0) selected--;
+                } else if (event == Event::Backspace || event.is_character()) {
+                    if (event.is_character()) {
+                        query += event.character();
+                    } else {
+                        // Removes a whole UTF-8 character
+                        while (!query.empty() && (static_cast<unsigned char>(query.back()) & 0xC0) == 0x80)
+                            query.pop_back();
+                        if (!query.empty())
+                            query.pop_back();
+                    }
+                    matches = cfg_.city_index_->Search(query, kSearchResults);
+                    selected = 0;
+                }
+                return true;
+            }
+            if (show_dashboard) {
+                bool moved = true;
+                if (event == Event::ArrowDown || (event.is_mouse() && event.mouse().button == Mouse::WheelDown)) {
+                    ++selected_row; // clamped on the next render
+                } else if (event == Event::ArrowUp || (event.is_mouse() && event.mouse().button == Mouse::WheelUp)) {
+                    if (selected_row > 0) selected_row--;
+                } else if (event == Event::PageDown) {
+                    selected_row += visible_rows;
+                } else if (event == Event::PageUp) {
+                    selected_row -= std::min(selected_row, visible_rows);
+                } else if (event == Event::Home) {
+                    selected_row = 0;
+                } else if (event == Event::End) {
+                    selected_row = dashboard.Size();
+                } else if (event == Event::Return && selected_row < dashboard.Size()) {
+                    current_city = cfg_.cities_.begin() + selected_row;
+                    first_day = 0;
+                    show_dashboard = false;
+                } else {
+                    moved = false;
+                }
+                if (moved)
+                    return true;
+            }
+            if (event.input() == "d") {
+                show_dashboard = !show_dashboard;
+                selected_row = current_city - cfg_.cities_.begin();
+            } else if (event.input() == "/") {
+                searching = true;
+                query.clear();
+                matches.clear();
+                selected = 0;
+            } else if (event == Event::Escape)
                 screen.ExitLoopClosure()();
             else if (event.input() == "+") {
                 if (cfg_.num_days_ < kMaxDays) cfg_.num_days_++;
             } else if (event.input() == "-") {
                 if (cfg_.num_days_ > kMinDays) cfg_.num_days_--;
+            } else if (event.input() == "s") {
+                show_stats = !show_stats;
+                if (show_stats)
+                    Stats::Enable();
             } else if (event.input() == "n") {
                 ++current_city;
                 if (current_city == cfg_.cities_.end())
                     current_city = cfg_.cities_.begin();
+                first_day = 0;
             } else if (event.input() == "p") {
                 if (current_city == cfg_.cities_.begin())
                     current_city = cfg_.cities_.end();
                 --current_city;
+                first_day = 0;
+            } else if (event == Event::ArrowDown
+                       || (event.is_mouse() && event.mouse().button == Mouse::WheelDown)) {
+                ++first_day; // clamped on the next render
+            } else if (event == Event::ArrowUp
+                       || (event.is_mouse() && event.mouse().button == Mouse::WheelUp)) {
+                if (first_day > 0) first_day--;
+            } else if (event == Event::PageDown) {
+                first_day += visible_days;
+            } else if (event == Event::PageUp) {
+                first_day -= std::min(first_day, visible_days);
+            } else if (event == Event::Home) {
+                first_day = 0;
+            } else if (event == Event::End) {
+                first_day = kMaxDays;
             }
             return false;
         });
 
-        Loop loop(&screen, component);
-        while(!loop.HasQuitted()) {
-            screen.Post(ftxui::Event::Custom);
-            loop.RunOnce();
-        }
+        // Frames are drawn only when an event (key, resize or posted update) arrives
+        screen.Loop(component);
+        fetcher.SetOnUpdate(nullptr);
     }
 
     void SetConfig(const Config& cfg) {
         cfg_ = cfg;
     }
 
-private:
-    inline bool CheckFile(const std::string& file_path) {
-        std::ifstream f(file_path.c_str());
-        return f.good();
+    // Day windows of `count` days starting at `first_day` plus kOverscanDays, one row of day parts per day.
+    // The other days are never built.
+    Element BuildTable(const std::string& city, const ForecastData& forecast,
+                       size_t first_day = 0, size_t count = kMaxDays) {
+        return BuildTable(city, forecast, forecast.Days(), first_day, count, nullptr);
     }
 
-    void ClearScreen() const {
-        std::system("cls");
-    }
-
-    std::string GetName(const uint8_t code) {
-        if (names_.find(code) != names_.end()) {
-            return names_[code];
+    // Same for the first `days` days of the forecast, day windows already in `rows` are reused and new ones added to it
+    Element BuildTable(const std::string& city, const ForecastData& forecast, size_t days,
+                       size_t first_day, size_t count, DayRows* rows) {
+        Elements windows;
+        windows.push_back(text("Weather forecast for: " + city) | center | bold | color(Color::White));
+
+        days = std::min(days, forecast.Days());
+        first_day = std::min(first_day, days);
+        size_t last_visible = std::min(days, first_day + count);
+        if (first_day > 0 || last_visible < days) {
+            windows.push_back(text("Days " + std::to_string(first_day + 1) + "-" + std::to_string(last_visible)
+                                   + " of " + std::to_string(days) + ", scroll with arrows, PgUp/PgDn or the mouse wheel")
+                              | center | color(Color::GrayLight));
         }
-        return names_[kUnknownCode];
-    }
 
-    std::vector<Element> GetImage(const uint8_t code) {
-        if (images_.find(code) != images_.end()) {
-            return images_[code]();
+        size_t end = std::min(days, last_visible + kOverscanDays);
+        for (size_t day = first_day; day < end; ++day) {
+            if (!rows) {
+                windows.push_back(BuildDay(forecast, day));
+                continue;
+            }
+            Element& row = rows->rows_[day];
+            if (!row)
+                row = BuildDay(forecast, day);
+            windows.push_back(row);
         }
-        return images_[kUnknownCode]();
+        return vbox(std::move(windows));
     }
 
-    std::vector<Element> GetDescription(const json& weather, const uint8_t day, const std::string& time) {
-        uint8_t begin{};
-        uint8_t end{};
-
-        if (time == "Morning") {
-            begin = kStartOfMorning;
-            end = kEndOfMorning;
-        } else if (time == "Noon") {
-            begin = kStartOfAfternoon;
-            end = kEndOfAfternoon;
-        } else if (time == "Evening") {
-            begin = kStartOfEvening;
-            end = kEndOfEvening;
-        } else {
-            begin = kStartOfNight;
-            end = kEndOfNight;
+    // Window of one day with a box per day part
+    Element BuildDay(const ForecastData& forecast, size_t day) {
+        Elements row;
+        row.reserve(kDayParts);
+
+        for (uint8_t id = 0; id < kDayParts; ++id) {
+            DayPart part = static_cast<DayPart>(id);
+            row.push_back(vbox({text(kDayPartNames[id]) | center | bold,
+                                separator(),
+                                hbox({
+                                GetCodeImage(GetWeatherCode(forecast, day, part)),
+                                vbox(GetDescription(forecast, day, part)) | border | size(WIDTH, EQUAL, kSmallBoxSize)
+                                }) | size(HEIGHT, EQUAL, kSpriteHeight)}) | border | size(WIDTH, EQUAL, kBoxSize));
         }
 
+        return window(text(std::string(forecast.Date(day))) | color(Color::DarkSeaGreen1) | center,
+                      vbox(hbox(std::move(row))));
+    }
+
+    std::vector<Element> GetDescription(const ForecastData& weather, size_t day, DayPart part) {
         std::vector<Element> description;
         description.reserve(kInfoOfDay);
 
-        size_t current_day = kHoursPerDay * day;
-        description.push_back(text(GetName(weather["hourly"]["weathercode"][current_day + end].get<uint8_t>())) | color(Color::DarkSeaGreen1));
-        Element temperatures = hbox(GetTempColor(GetAverage(weather["hourly"]["temperature_2m"],
-                                            current_day + begin,
-                                            current_day + end)),
+        const DayPartSummaries& summaries = weather.summaries_;
+        description.push_back(text(std::string(GetCodeName(GetWeatherCode(weather, day, part)))) | color(Color::DarkSeaGreen1));
+        Element temperatures = hbox(GetTempColor(GetAverage(summaries, day, part, Variable::Temperature)),
                                     text("("),
-                                    GetTempColor(GetAverage(weather["hourly"]["apparent_temperature"],
-                                            current_day + begin,
-                                            current_day + end)),
+                                    GetTempColor(GetAverage(summaries, day, part, Variable::ApparentTemperature)),
                                     text(")°C"));
         description.push_back(temperatures);
 
-        description.push_back(text(GetAverage(weather["hourly"]["windspeed_10m"],
-                                            current_day + begin,
-                                            current_day + end) + " км/ч"));
+        description.push_back(text(FormatNumber(GetAverage(summaries, day, part, Variable::Windspeed), " км/ч")));
 
-        description.push_back(text(GetAverage(weather["hourly"]["relativehumidity_2m"],
-                                            current_day + begin,
-                                            current_day + end) + "%"));
+        description.push_back(text(FormatNumber(GetAverage(summaries, day, part, Variable::Humidity), "%")));
         return description;
     }
 
-    uint8_t GetWeatherCode(const json& weather, const uint8_t day, const std::string& time) const {
-        uint8_t end = 0;
-        if (time == "Morning") {
-            end = kEndOfMorning;
-        } else if (time == "Noon") {
-            end = kEndOfAfternoon;
-        } else if (time == "Evening") {
-            end = kEndOfEvening;
-        } else {
-            end = kEndOfNight;
+    // When the shown forecast was downloaded, and why it wasn't replaced if it is out of date
+    Element GetAge(const ForecastSnapshot& snapshot, bool fresh, const std::optional<std::string>& error) const {
+        auto minutes = std::chrono::duration_cast<std::chrono::minutes>(std::chrono::system_clock::now() - snapshot.fetched_at_).count();
+        std::string age = minutes < 1 ? "just now"
+                          : minutes < 60 ? std::to_string(minutes) + " min ago"
+                          : std::to_string(minutes / 60) + " h " + std::to_string(minutes % 60) + " min ago";
+        if (fresh)
+            return text("Updated " + age) | color(Color::GrayLight) | center;
+        std::string reason = error ? ", refresh failed: " + *error : ", refreshing...";
+        return text("Out of date, updated " + age + reason) | color(Color::Yellow) | center;
+    }
+
+    // Search box with the query and the best matches, the selected one highlighted
+    Element GetSearch(const std::string& query, const std::vector<uint32_t>& matches, size_t selected) const {
+        Elements lines;
+        lines.push_back(hbox(text("> ") | color(Color::DarkSeaGreen1), text(query), text("_") | color(Color::GrayLight)));
+        lines.push_back(separator());
+        if (matches.empty())
+            lines.push_back(text(query.empty() ? "Type a city name" : "No matching city") | color(Color::GrayLight));
+        for (size_t i = 0; i < matches.size(); ++i) {
+            Element line = text(std::string(cfg_.city_index_->Name(matches[i])));
+            lines.push_back(i == selected ? line | inverted : line);
         }
+        return window(text("Go to city") | color(Color::DarkSeaGreen1), vbox(std::move(lines)) | size(WIDTH, EQUAL, 40))
+               | color(Color::White);
+    }
 
-        size_t current = day * kHoursPerDay + end;
-        return weather["hourly"]["weathercode"][current].get<size_t>();
+    // Lines `first_row` to `first_row + count` of the dashboard, lines without a forecast yet say why
+    Element GetDashboard(const Dashboard& dashboard, Fetcher& fetcher, size_t first_row, size_t count, size_t selected) const {
+        Elements lines;
+        lines.push_back(text("Dashboard: " + std::to_string(dashboard.Ready()) + " of " + std::to_string(dashboard.Size())
+                             + " cities, " + std::to_string(cfg_.num_days_) + " days. `Enter` opens the selected city")
+                        | center | bold | color(Color::White));
+        Elements names = {text("City") | size(WIDTH, EQUAL, kCityColumn), text("Now") | size(WIDTH, EQUAL, kConditionColumn),
+                          text("°C") | size(WIDTH, EQUAL, kValueColumn), text("км/ч") | size(WIDTH, EQUAL, kValueColumn),
+                          text("%") | size(WIDTH, EQUAL, kValueColumn)};
+        for (const char* day : kDashboardDayNames)
+            names.push_back(text(day) | size(WIDTH, EQUAL, kRangeColumn));
+        names.push_back(text(std::to_string(cfg_.num_days_) + " days") | size(WIDTH, EQUAL, kRangeColumn));
+        lines.push_back(hbox(std::move(names)) | bold | color(Color::DarkSeaGreen1));
+        lines.push_back(separator());
+
+        size_t end = std::min(dashboard.Size(), first_row + count);
+        for (size_t i = first_row; i < end; ++i) {
+            const std::string& city = dashboard.City(i);
+            Elements cells = {text(city) | size(WIDTH, EQUAL, kCityColumn)};
+            std::shared_ptr<const CityRow> row = dashboard.Get(i);
+            if (!row) {
+                std::optional<std::string> error = fetcher.GetError(city);
+                cells.push_back(error ? text("Error: " + *error) | color(Color::Yellow)
+                                      : text("Loading forecast...") | color(Color::GrayLight));
+            } else {
+                cells.push_back(text(std::string(GetCodeName(row->weather_code_))) | color(Color::DarkSeaGreen1)
+                                | size(WIDTH, EQUAL, kConditionColumn));
+                cells.push_back(GetTempColor(ToInt(row->temperature_)) | size(WIDTH, EQUAL, kValueColumn));
+                cells.push_back(text(FormatNumber(ToInt(row->windspeed_))) | size(WIDTH, EQUAL, kValueColumn));
+                cells.push_back(text(FormatNumber(row->humidity_ == kMissingValue ? std::nullopt : std::optional<int>(row->humidity_)))
+                                | size(WIDTH, EQUAL, kValueColumn));
+                for (uint8_t day = 0; day < kDashboardDays; ++day)
+                    cells.push_back(GetRange(row->min_temperature_[day], row->max_temperature_[day]));
+                cells.push_back(GetRange(row->horizon_min_temperature_, row->horizon_max_temperature_));
+            }
+            Element line = hbox(std::move(cells));
+            lines.push_back(i == selected ? line | inverted : line);
+        }
+        return vbox(std::move(lines));
     }
 
-    std::string GetAverage(const nlohmann::basic_json<>& current, size_t left, size_t right) const {
-        return current != 0 ? std::to_string(int((current[left].get<double>() + current[right].get<double>()) / 2)) : "error";
+    // Temperature range cell of the dashboard, empty past the horizon
+    Element GetRange(float min, float max) const {
+        if (std::isnan(min) && std::isnan(max))
+            return text("") | size(WIDTH, EQUAL, kRangeColumn);
+        return hbox(GetTempColor(ToInt(min)), text(".."), GetTempColor(ToInt(max))) | size(WIDTH, EQUAL, kRangeColumn);
     }
 
-    Element GetTempColor(const std::string& temperature) const {
-        int temp = std::stoi(temperature);
-        Element result;
+    // Stage latencies and counters collected so far
+    Element GetStats() const {
+        auto milliseconds = [](uint64_t ns) {
+            std::ostringstream stream;
+            stream << std::fixed << std::setprecision(2) << ns / 1e6 << " ms";
+            return stream.str();
+        };
+        std::vector<std::vector<std::string>> rows = {{"Stage", "Count", "p50", "p99", "Max"}};
+        for (uint8_t stage = 0; stage < kStages; ++stage) {
+            const Histogram& histogram = Stats::Get(static_cast<Stage>(stage));
+            rows.push_back({kStageNames[stage], std::to_string(histogram.Count()),
+                            milliseconds(histogram.Percentile(0.5)), milliseconds(histogram.Percentile(0.99)),
+                            milliseconds(histogram.Max())});
+        }
+        const Histogram& frames = Stats::FrameAllocations();
+        if (frames.Count() > 0 && Stats::Get(Counter::Allocations) > 0) {
+            rows.push_back({"Allocs/frame", std::to_string(frames.Count()), std::to_string(frames.Percentile(0.5)),
+                            std::to_string(frames.Percentile(0.99)), std::to_string(frames.Max())});
+        }
+        Elements lines;
+        for (const auto& row : rows) {
+            Elements cells;
+            for (const auto& cell : row)
+                cells.push_back(text(cell) | size(WIDTH, EQUAL, 12));
+            lines.push_back(hbox(std::move(cells)));
+        }
+        lines.push_back(separator());
+        if (std::optional<std::chrono::nanoseconds> first_table = Stats::FirstTable())
+            lines.push_back(hbox({text("First table") | size(WIDTH, EQUAL, 24), text(milliseconds(first_table->count()))}));
+        for (uint8_t counter = 0; counter < kCounters; ++counter) {
+            lines.push_back(hbox({text(kCounterNames[counter]) | size(WIDTH, EQUAL, 24),
+                                  text(std::to_string(Stats::Get(static_cast<Counter>(counter))))}));
+        }
+        return window(text("Statistics") | color(Color::DarkSeaGreen1), vbox(std::move(lines))) | color(Color::White);
+    }
+
+    // Weather at the last hour of the day part
+    uint8_t GetWeatherCode(const ForecastData& weather, size_t day, DayPart part) const {
+        return weather.WeatherCode(day * kHoursPerDay + kDayPartHours[static_cast<uint8_t>(part)].second);
+    }
+
+private:
+    // Memoized day windows of the city, emptied if its forecast changed since they were built
+    DayRows& GetDayRows(const std::string& city, uint64_t generation) {
+        if (!day_rows_.contains(city) && day_rows_.size() >= kRowCacheCities) {
+            auto oldest = std::min_element(day_rows_.begin(), day_rows_.end(), [](const auto& left, const auto& right) {
+                return left.second.last_used_ < right.second.last_used_;
+            });
+            day_rows_.erase(oldest);
+        }
+        DayRows& rows = day_rows_[city];
+        if (rows.generation_ != generation) {
+            rows.rows_.fill(nullptr);
+            rows.generation_ = generation;
+        }
+        rows.last_used_ = ++day_rows_uses_;
+        return rows;
+    }
+
+    inline bool CheckFile(const std::string& file_path) {
+        std::ifstream f(file_path.c_str());
+        return f.good();
+    }
+
+    // ANSI erase display, scrollback and cursor home, without spawning a shell
+    void ClearScreen() const {
+#ifdef _WIN32
+        // The console prints the escapes as text until virtual terminal processing is on, and the first
+        // FTXUI screen turns it on only later. Consoles older than Windows 10 don't have it at all.
+        HANDLE output = GetStdHandle(STD_OUTPUT_HANDLE); // windows.h comes with DiskCache.hpp
+        DWORD mode = 0;
+        if (output == INVALID_HANDLE_VALUE || !GetConsoleMode(output, &mode)
+            || !SetConsoleMode(output, mode | ENABLE_VIRTUAL_TERMINAL_PROCESSING)) {
+            std::system("cls");
+            return;
+        }
+#endif
+        std::cout << "\x1b[2J\x1b[3J\x1b[H" << std::flush;
+    }
+
+    // Mean of the day part rounded toward zero, empty for a missing day or value
+    std::optional<int> GetAverage(const DayPartSummaries& summaries, size_t day, DayPart part, Variable variable) const {
+        if (day >= summaries.Days())
+            return std::nullopt;
+        return ToInt(summaries.Get(day, part, variable).mean_);
+    }
+
+    // Rounded toward zero, empty for a missing value
+    static std::optional<int> ToInt(float value) {
+        if (std::isnan(value))
+            return std::nullopt;
+        return static_cast<int>(value);
+    }
+
+    // Formats through a stack buffer, the result stays within the small string optimization and doesn't allocate
+    static std::string FormatNumber(std::optional<int> value, std::string_view unit = {}) {
+        std::array<char, kNumberBuffer> buffer;
+        char* end = buffer.data();
+        if (value)
+            end = std::to_chars(end, buffer.data() + buffer.size(), *value).ptr;
+        else
+            *end++ = '-';
+        size_t length = std::min<size_t>(unit.size(), buffer.data() + buffer.size() - end);
+        end = std::copy_n(unit.data(), length, end);
+        return std::string(buffer.data(), end);
+    }
+
+    Element GetTempColor(std::optional<int> temperature) const {
+        Element result = text(FormatNumber(temperature));
+        if (!temperature)
+            return result;
+        int temp = *temperature;
         if (temp < -10) {
-            return text(temperature) | color(Color::NavyBlue);
-        } else if (temp >= -10 && temp < -5) {
-            return text(temperature) | color(Color::Blue);
-        } else if (temp >= -5 && temp < 0) {
-            return text(temperature) | color(Color::BlueLight);
-        } else if (temp >= 0 && temp < 5) {
-            return text(temperature) | color(Color::Green);
-        } else if (temp >= 5 && temp < 10) {
-            return text(temperature) | color(Color::GreenLight);
-        } else if (temp >= 10 && temp < 15) {
-            return text(temperature) | color(Color::Yellow);
-        } else if (temp >= 15 && temp < 20) {
-            return text(temperature) | color(Color::YellowLight);
-        } else if (temp >= 20 && temp < 25) {
-            return text(temperature) | color(Color::Salmon1);
+            return result | color(Color::NavyBlue);
+        } else if (temp < -5) {
+            return result | color(Color::Blue);
+        } else if (temp < 0) {
+            return result | color(Color::BlueLight);
+        } else if (temp < 5) {
+            return result | color(Color::Green);
+        } else if (temp < 10) {
+            return result | color(Color::GreenLight);
+        } else if (temp < 15) {
+            return result | color(Color::Yellow);
+        } else if (temp < 20) {
+            return result | color(Color::YellowLight);
+        } else if (temp < 25) {
+            return result | color(Color::Salmon1);
         } else {
-            return text(temperature) | color(Color::RedLight);
+            return result | color(Color::RedLight);
         }
     }
 
@@ -377,148 +833,4 @@ private:
                 }) | xflex | borderDouble | bold;
         });
     }
-
-    void FillMaps() {
-        names_[0] = "Clear sky";
-        names_[1] = "Mainly clear";
-        names_[2] = "Partly cloudy";
-        names_[3] = "Overcast";
-
-        names_[45] = names_[48] = "Fog";
-
-        names_[51] = "Light drizzle";
-        names_[53] = "Moderate drizzle";
-        names_[55] = "Dense drizzle";
-        names_[56] = "Light freezing drizzle";
-        names_[57] = "Dense freezing drizzle";
-
-        names_[61] = "Slight rain";
-        names_[63] = "Moderate rain";
-        names_[65] = "Heavy rain";
-
-        names_[66] = "Light freezing rain";
-        names_[67] = "Heavy freezing rain";
-
-        names_[71] = "Slight snow fall";
-        names_[73] = "Moderate snow fall";
-        names_[75] = "Heavy snow fall";
-
-        names_[77] = "Snow grains";
-
-        names_[80] = "Slight rain showers";
-        names_[81] = "Moderate rain showers";
-        names_[82] = "Violent rain showers";
-
-        names_[95] = "Thunderstorm";
-        names_[96] = "Thunderstorm with slight hail";
-        names_[99] = "Thunderstorm with heavy hail";
-
-        names_[kUnknownCode] = "Неизвестный Код";
-
-
-        images_[0] = []() {
-            return std::vector<Element> {
-            text("    \\    |    /   ") | color(Color::YellowLight),
-            text("     '.-----.'     ") | color(Color::YellowLight),
-            text("     /       \\    ") | color(Color::YellowLight),
-            text(" ---|         |--- ") | color(Color::YellowLight),
-            text("     \\       /    ") | color(Color::YellowLight),
-            text("     ,'-----'.     ") | color(Color::YellowLight),
-            text("    /    |    \\   ") | color(Color::YellowLight)};
-        };
-
-        images_[1] = images_[2] = []() {
-            return std::vector<Element> {
-            hbox(text("    \\    ") | color(Color::YellowLight), text("|") | color(Color::White), text("~       ~~") | color(Color::GrayLight)),
-            hbox(text("     '.--") | color(Color::YellowLight), text("|") | color(Color::White), text(",----,    ") | color(Color::GrayLight)),
-            hbox(text("     /   ") | color(Color::YellowLight), text("|") | color(Color::White), text(" --   )~  ") | color(Color::GrayLight)),
-            hbox(text(" ---|    ") | color(Color::YellowLight), text("|") | color(Color::White), text(" '-'   )  ") | color(Color::GrayLight)),
-            hbox(text("     \\   ") | color(Color::YellowLight), text("|") | color(Color::White), text("--/    )  ") | color(Color::GrayLight)),
-            hbox(text("     ,'--") | color(Color::YellowLight), text("|") | color(Color::White), text("\"-----'    ") | color(Color::GrayLight)),
-            hbox(text("    /    ") | color(Color::YellowLight), text("|") | color(Color::White), text("     ~~  ") | color(Color::GrayLight))};
-        };
-
-        images_[3] = images_[45] = images_[48] = []() {
-            return std::vector<Element> {
-            hbox(text("  ~~     ~~~      ~~") | color(Color::White)),
-            hbox(text("   ,-----,,----,") | color(Color::GrayLight), text("~~  ") | color(Color::White)),
-            hbox(text("  (  --    --   )") | color(Color::GrayLight) , text("~~ ") | color(Color::White)),
-            hbox(text(" (   '-'   '-'   )  ") | color(Color::GrayLight)),
-            hbox(text(" ~") | color(Color::White), text("(     ---/    )   ") | color(Color::GrayLight)),
-            hbox(text("   '-----\"\"----' ") | color(Color::GrayLight), text("~~ ") | color(Color::White)),
-            hbox(text("     ~~~      ~~~   ") | color(Color::White))};
-        };
-
-        images_[51] = images_[53] = images_[55] = images_[56] = images_[57] = images_[61] = []() {
-            return std::vector<Element> {
-            text("   ,-----,,----,    ") | color(Color::GrayLight),
-            text("  (  --    --   )   ") | color(Color::GrayLight),
-            text(" (   '-'   '-'   )  ") | color(Color::GrayLight),
-            text("  (      ---/    )  ") | color(Color::GrayLight),
-            text("   '---,-\"\"--,--'   ") | color(Color::GrayLight),
-            text("  , , ,  ,  , ,     ") | color(Color::BlueLight),
-            text(" , ,   ,  , ,       ") | color(Color::BlueLight)};
-        };
-
-        images_[63] = images_[65] = images_[80] = images_[81] = images_[82] = []() {
-            return std::vector<Element> {
-            text("   ,-----,,----,    ") | color(Color::GrayDark),
-            text("  (  -^-   -^-  )   ") | color(Color::GrayDark),
-            text(" (   '.'   '.'   )  ") | color(Color::GrayDark),
-            text("  (     _---_    )   ") | color(Color::GrayDark),
-            text("   '---,-\"\"--,--'  ") | color(Color::GrayDark),
-            text("  /  /    / /  /    ") | color(Color::Blue),
-            text("  /  / /   /   /    ") | color(Color::Blue)};
-        };
-
-        images_[66] = images_[67] = []() {
-            return std::vector<Element> {
-            text("   ,-----,,----,    ") | color(Color::GrayDark),
-            text("  (  -^-   -^-  )   ") | color(Color::GrayDark),
-            text(" (   '.'   '.'   )  ") | color(Color::GrayDark),
-            text("  (     _---_    )  ") | color(Color::GrayDark),
-            text("   '---,-\"\"--,--'   ") | color(Color::GrayDark),
-            hbox(text("  *  ") | color(Color::White), text("/  ") | color(Color::BlueLight), 
-                text("* ") | color(Color::White), text("/ ") | color(Color::BlueLight), 
-                text("*  ") | color(Color::White), text("/ ") | color(Color::BlueLight), 
-                text("*  ") | color(Color::White)),
-            hbox(text(" /  ") | color(Color::BlueLight), text("* ") | color(Color::White), text("/ ") | color(Color::BlueLight), 
-                text("* ") | color(Color::White), text("/  ") | color(Color::BlueLight), text("* ") | color(Color::White), 
-                text("/    ") | color(Color::BlueLight))};
-        };
-
-        images_[71] = images_[73] = images_[75] = images_[77] = []() {
-            return std::vector<Element> {
-            text("   ,-----,,----,   ") | color(Color::GrayLight),
-            text("  (  --    --   )  ") | color(Color::GrayLight),
-            text(" (   '-'   '-'   ) ") | color(Color::GrayLight),
-            text("  (      ---/    ) ") | color(Color::GrayLight),
-            text("   '---,-\"\"--,-'   ") | color(Color::GrayLight),
-            text("   *  *   * *  *   ") | color(Color::White),
-            text("  *  *  *  *  *    ") | color(Color::White)};
-        };
-
-        images_[95] = images_[96] = images_[99] = []() {
-            return std::vector<Element> {
-            text("   ,-----,,----,      ") | color(Color::GrayDark),
-            text("  (  -^-   -^-  )     ") | color(Color::GrayDark),
-            text(" (    .     .    )    ") | color(Color::GrayDark),
-            text("  (   \\^-^-^/    )   ") | color(Color::GrayDark),
-            text("   ',,-,--,,--,-'     ") | color(Color::GrayDark),
-            text("    //    //  //      ") | color(Color::YellowLight),
-            text("    \\\\   \\\\   \\\\  ") | color(Color::YellowLight),
-            text("    /    /     /      ") | color(Color::YellowLight)};
-        };
-
-        images_[kUnknownCode] = []() {
-            return std::vector<Element> {
-            text("   ,------.   ") | color(Color::Magenta),
-            text("  '  .--.  '  ") | color(Color::Magenta),
-            text("  '--' _|  |  ") | color(Color::Magenta),
-            text("    .--' __'  ") | color(Color::Magenta),
-            text("    `---'     ") | color(Color::Magenta),
-            text("    .---.     ") | color(Color::Magenta),
-            text("    '---'     ") | color(Color::Magenta)};
-        };
-    }
 };
@@ -0,0 +1,214 @@
+#pragma once
+
+#include "Weather.hpp"
+
+#include <array>
+#include <cmath>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <thread>
+
+const uint8_t kDashboardWorkers = 4;
+const uint8_t kDashboardDays = 4; // days with a column of their own
+
+// One line of the dashboard: the current conditions and the daily temperature range (min and max of the
+// whole day, not of its parts) of the first days and of the whole horizon. Computed from the daily
+// aggregates, so the overview download is enough; day parts would need the hours of every city.
+struct CityRow
+{
+    uint64_t generation_ = 0; // of the forecast it was computed from
+    uint8_t days_ = 0;
+    uint8_t weather_code_ = kMissingValue;
+    float temperature_ = std::numeric_limits<float>::quiet_NaN();
+    float windspeed_ = std::numeric_limits<float>::quiet_NaN();
+    uint8_t humidity_ = kMissingValue;
+    std::array<float, kDashboardDays> min_temperature_; // NaN past the horizon
+    std::array<float, kDashboardDays> max_temperature_;
+    float horizon_min_temperature_ = std::numeric_limits<float>::quiet_NaN();
+    float horizon_max_temperature_ = std::numeric_limits<float>::quiet_NaN();
+};
+
+// Summary rows of many cities, computed on a few worker threads from forecasts that are already downloaded.
+// Rows are queued again whenever Update reports new data for their city or the horizon changes,
+// the UI reads the finished ones without waiting for the rest.
+class Dashboard
+{
+private:
+    std::vector<std::string> cities_;
+    std::vector<std::shared_ptr<const ForecastSlot>> slots_;
+    std::unordered_map<std::string, std::vector<uint32_t>> rows_of_; // city -> its rows, names may repeat
+    std::vector<std::shared_ptr<const CityRow>> rows_;
+    size_t ready_ = 0;
+    uint8_t days_;
+    std::deque<uint32_t> queue_;
+    std::vector<bool> queued_;
+    std::function<void()> on_change_;
+    std::atomic<bool> change_posted_ = false;
+    std::vector<std::thread> workers_;
+    mutable std::mutex mutex_;
+    std::condition_variable has_work_;
+    bool stopping_ = false;
+
+public:
+    // on_change is called from a worker thread once rows changed since the last MarkDrawn
+    Dashboard(Weather& weather, const std::vector<std::string>& cities, uint8_t days, std::function<void()> on_change,
+              uint8_t num_workers = kDashboardWorkers)
+        : cities_(cities)
+        , rows_(cities.size())
+        , days_(days)
+        , queued_(cities.size(), false)
+        , on_change_(std::move(on_change))
+    {
+        slots_.reserve(cities_.size());
+        for (uint32_t i = 0; i < cities_.size(); ++i) {
+            slots_.push_back(weather.Watch(cities_[i]));
+            rows_of_[cities_[i]].push_back(i);
+            Queue(i);
+        }
+        for (uint8_t i = 0; i < num_workers; ++i)
+            workers_.emplace_back([this] { Work(); });
+    }
+
+    ~Dashboard() {
+        {
+            std::lock_guard lock(mutex_);
+            stopping_ = true;
+        }
+        has_work_.notify_all();
+        for (auto& worker : workers_)
+            worker.join();
+    }
+
+    // Recomputes the rows of cities with new forecasts, e.g. from Fetcher::SetOnUpdate
+    void Update(const std::vector<std::string>& cities) {
+        {
+            std::lock_guard lock(mutex_);
+            for (const auto& city : cities) {
+                auto rows = rows_of_.find(city);
+                if (rows == rows_of_.end())
+                    continue;
+                for (uint32_t row : rows->second)
+                    Queue(row);
+            }
+        }
+        has_work_.notify_all();
+    }
+
+    void SetDays(uint8_t days) {
+        {
+            std::lock_guard lock(mutex_);
+            if (days == days_)
+                return;
+            days_ = days;
+            for (uint32_t row = 0; row < rows_.size(); ++row)
+                Queue(row);
+        }
+        has_work_.notify_all();
+    }
+
+    // Empty until the city has a forecast
+    std::shared_ptr<const CityRow> Get(size_t row) const {
+        std::lock_guard lock(mutex_);
+        return rows_[row];
+    }
+
+    const std::string& City(size_t row) const {
+        return cities_[row];
+    }
+
+    size_t Size() const {
+        return cities_.size();
+    }
+
+    // Rows computed at least once
+    size_t Ready() const {
+        std::lock_guard lock(mutex_);
+        return ready_;
+    }
+
+    // Called before the rows are read for a frame, changes after it post a new one
+    void MarkDrawn() {
+        change_posted_.store(false);
+    }
+
+    // The current conditions come with the overview. Without them, or when the hours were downloaded later,
+    // the current hour of the city is taken: the forecast is in the city's time zone and starts at its midnight.
+    static CityRow Summarize(const ForecastSnapshot& snapshot, uint8_t days) {
+        const ForecastData& forecast = snapshot.forecast_;
+        const DailyForecast& daily = snapshot.daily_;
+        CityRow row;
+        row.generation_ = snapshot.generation_;
+        row.days_ = days;
+        if (daily.HasCurrent() && (forecast.Days() == 0 || snapshot.daily_fetched_at_ >= snapshot.fetched_at_)) {
+            row.weather_code_ = daily.Current().weathercode_;
+            row.temperature_ = daily.CurrentTemperature();
+            row.windspeed_ = daily.CurrentWindspeed();
+            row.humidity_ = daily.Current().humidity_;
+        } else if (forecast.Days() > 0) {
+            auto fetched_day = std::chrono::floor<std::chrono::days>(snapshot.fetched_at_ + snapshot.utc_offset_);
+            auto hours = std::chrono::floor<std::chrono::hours>(std::chrono::system_clock::now() + snapshot.utc_offset_ - fetched_day);
+            size_t hour = std::clamp<int64_t>(hours.count(), 0, forecast.Hours() - 1);
+            row.weather_code_ = forecast.WeatherCode(hour);
+            row.temperature_ = forecast.Temperature(hour);
+            row.windspeed_ = forecast.Windspeed(hour);
+            row.humidity_ = forecast.Humidity(hour);
+        }
+        size_t horizon = std::min<size_t>(days, daily.Days());
+        row.min_temperature_.fill(std::numeric_limits<float>::quiet_NaN());
+        row.max_temperature_.fill(std::numeric_limits<float>::quiet_NaN());
+        for (size_t day = 0; day < horizon; ++day) {
+            if (day < kDashboardDays) {
+                row.min_temperature_[day] = daily.TemperatureMin(day);
+                row.max_temperature_[day] = daily.TemperatureMax(day);
+            }
+            // fmin and fmax skip the missing values
+            row.horizon_min_temperature_ = std::fmin(row.horizon_min_temperature_, daily.TemperatureMin(day));
+            row.horizon_max_temperature_ = std::fmax(row.horizon_max_temperature_, daily.TemperatureMax(day));
+        }
+        return row;
+    }
+
+private:
+    // Expects mutex_ to be held
+    void Queue(uint32_t row) {
+        if (queued_[row])
+            return;
+        queued_[row] = true;
+        queue_.push_back(row);
+    }
+
+    void Work() {
+        while (true) {
+            uint32_t row = 0;
+            uint8_t days = 0;
+            {
+                std::unique_lock lock(mutex_);
+                has_work_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+                if (stopping_)
+                    return;
+                row = queue_.front();
+                queue_.pop_front();
+                queued_[row] = false;
+                days = days_;
+            }
+
+            std::shared_ptr<const ForecastSnapshot> snapshot = slots_[row]->load();
+            if (!snapshot)
+                continue;
+            auto summary = std::make_shared<const CityRow>(Summarize(*snapshot, days));
+            {
+                std::lock_guard lock(mutex_);
+                // The horizon may have changed and a newer forecast been summarized meanwhile
+                const std::shared_ptr<const CityRow>& current = rows_[row];
+                if (days != days_ || (current && current->generation_ > summary->generation_))
+                    continue;
+                if (!current)
+                    ++ready_;
+                rows_[row] = std::move(summary);
+            }
+            if (!change_posted_.exchange(true) && on_change_)
+                on_change_();
+        }
+    }
+};
@@ -0,0 +1,323 @@
+#pragma once
+
+#include "ForecastData.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#ifdef _WIN32
+// Keep windows.h from defining min, max and the GDI macros like RGB, which break ftxui::Color::RGB
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOGDI
+#define NOGDI
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+const char kCacheMagic[4] = {'W', 'F', 'C', 'B'};
+const uint32_t kCacheVersion = 5;
+const uint32_t kCacheByteOrder = 0x01020304; // reads back differently on a machine of the other byte order
+const size_t kMaxNameLength = std::numeric_limits<uint16_t>::max();
+
+// Read-only memory mapping of a whole file, empty if the file can't be opened
+class MappedFile
+{
+private:
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+#ifdef _WIN32
+    HANDLE file_ = INVALID_HANDLE_VALUE;
+    HANDLE mapping_ = nullptr;
+#else
+    int file_ = -1;
+#endif
+
+public:
+    explicit MappedFile(const std::filesystem::path& path) {
+#ifdef _WIN32
+        file_ = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        LARGE_INTEGER size;
+        if (file_ == INVALID_HANDLE_VALUE || !GetFileSizeEx(file_, &size) || size.QuadPart == 0)
+            return;
+        mapping_ = CreateFileMappingW(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping_ == nullptr)
+            return;
+        data_ = static_cast<const char*>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+        size_ = data_ != nullptr ? static_cast<size_t>(size.QuadPart) : 0;
+#else
+        file_ = open(path.c_str(), O_RDONLY);
+        struct stat info;
+        if (file_ < 0 || fstat(file_, &info) != 0 || info.st_size == 0)
+            return;
+        void* data = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, file_, 0);
+        if (data == MAP_FAILED)
+            return;
+        data_ = static_cast<const char*>(data);
+        size_ = info.st_size;
+#endif
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile() {
+#ifdef _WIN32
+        if (data_ != nullptr)
+            UnmapViewOfFile(data_);
+        if (mapping_ != nullptr)
+            CloseHandle(mapping_);
+        if (file_ != INVALID_HANDLE_VALUE)
+            CloseHandle(file_);
+#else
+        if (data_ != nullptr)
+            munmap(const_cast<char*>(data_), size_);
+        if (file_ >= 0)
+            close(file_);
+#endif
+    }
+
+    std::string_view View() const {
+        return {data_, size_};
+    }
+};
+
+// Geocoding results and forecasts kept between runs.
+//
+// File layout (native byte order and struct layout, no padding between fields). The cache never leaves the
+// machine, so the records are written as they are in memory; the header tells a foreign file apart:
+//   header:   magic "WFCB", u32 version, u32 0x01020304, u8 sizeof(DayAggregates), u8 sizeof(CurrentConditions),
+//             u32 location count, u32 forecast count
+//   location: u16 name length, name, f64 latitude, f64 longitude
+//   forecast: u16 key length, key, i64 fetch time (unix seconds), i32 utc offset (seconds), u16 days,
+//             the block of ForecastData as it is in memory (8 bytes per hour, 10 per day),
+//             i64 fetch time of the overview, u16 overview days, DayAggregates per day, CurrentConditions.
+//             Either part has 0 days when its view was never downloaded.
+class DiskCache
+{
+public:
+    struct Location {
+        std::string city_;
+        double latitude_;
+        double longitude_;
+    };
+
+    struct StoredForecast {
+        std::string key_;
+        int64_t fetched_at_;
+        int32_t utc_offset_;
+        ForecastData forecast_;
+        int64_t daily_fetched_at_;
+        DailyForecast daily_;
+    };
+
+    struct Contents {
+        std::vector<Location> locations_;
+        std::vector<StoredForecast> forecasts_;
+    };
+
+private:
+    std::filesystem::path path_;
+
+public:
+    DiskCache() {}
+
+    explicit DiskCache(const std::filesystem::path& path)
+        : path_(path)
+    {}
+
+    const std::filesystem::path& GetPath() const {
+        return path_;
+    }
+
+    // Returns whatever was stored, or nothing if the file is missing, outdated or damaged
+    Contents Load() const {
+        Contents contents;
+        MappedFile file(path_);
+        Reader reader{file.View()};
+
+        char magic[sizeof(kCacheMagic)];
+        uint32_t version = 0;
+        uint32_t byte_order = 0;
+        uint8_t aggregates_size = 0;
+        uint8_t current_size = 0;
+        uint32_t num_locations = 0;
+        uint32_t num_forecasts = 0;
+        if (!reader.Read(magic, sizeof(magic)) || std::memcmp(magic, kCacheMagic, sizeof(magic)) != 0
+            || !reader.Read(version) || version != kCacheVersion
+            || !reader.Read(byte_order) || byte_order != kCacheByteOrder
+            || !reader.Read(aggregates_size) || aggregates_size != sizeof(DayAggregates)
+            || !reader.Read(current_size) || current_size != sizeof(CurrentConditions)
+            || !reader.Read(num_locations) || !reader.Read(num_forecasts))
+            return {};
+
+        for (uint32_t i = 0; i < num_locations; ++i) {
+            Location location;
+            if (!reader.Read(location.city_) || !reader.Read(location.latitude_) || !reader.Read(location.longitude_))
+                return {};
+            contents.locations_.push_back(std::move(location));
+        }
+
+        for (uint32_t i = 0; i < num_forecasts; ++i) {
+            StoredForecast stored;
+            uint16_t days = 0;
+            std::vector<int16_t> block;
+            uint16_t daily_days = 0;
+            std::vector<DayAggregates> aggregates;
+            CurrentConditions current;
+            if (!reader.Read(stored.key_) || !reader.Read(stored.fetched_at_) || !reader.Read(stored.utc_offset_) || !reader.Read(days)
+                || !reader.Read(block, ForecastData::BlockSize(days))
+                || !ForecastData::FromBlock(days, std::move(block), stored.forecast_)
+                || !reader.Read(stored.daily_fetched_at_) || !reader.Read(daily_days)
+                || !reader.Read(aggregates, daily_days) || !reader.Read(current))
+                return {};
+            stored.daily_ = DailyForecast(std::move(aggregates), current);
+            contents.forecasts_.push_back(std::move(stored));
+        }
+        return contents;
+    }
+
+    // Writes a temporary file next to the cache, flushes it to the disk and renames it over the old one,
+    // so a crash midway never leaves a half-written cache behind
+    void Save(const Contents& contents) const {
+        std::string buffer;
+        buffer.append(kCacheMagic, sizeof(kCacheMagic));
+        Append(buffer, kCacheVersion);
+        Append(buffer, kCacheByteOrder);
+        Append(buffer, static_cast<uint8_t>(sizeof(DayAggregates)));
+        Append(buffer, static_cast<uint8_t>(sizeof(CurrentConditions)));
+        // Names longer than the u16 length field are left out, those cities are geocoded again next time
+        auto fits = [](const Location& location) { return location.city_.size() <= kMaxNameLength; };
+        Append(buffer, static_cast<uint32_t>(std::count_if(contents.locations_.begin(), contents.locations_.end(), fits)));
+        Append(buffer, static_cast<uint32_t>(contents.forecasts_.size()));
+
+        for (const auto& location : contents.locations_) {
+            if (!fits(location))
+                continue;
+            Append(buffer, location.city_);
+            Append(buffer, location.latitude_);
+            Append(buffer, location.longitude_);
+        }
+
+        for (const auto& stored : contents.forecasts_) {
+            Append(buffer, stored.key_);
+            Append(buffer, stored.fetched_at_);
+            Append(buffer, stored.utc_offset_);
+            Append(buffer, static_cast<uint16_t>(stored.forecast_.Days()));
+            Append(buffer, stored.forecast_.Block());
+            Append(buffer, stored.daily_fetched_at_);
+            Append(buffer, static_cast<uint16_t>(stored.daily_.Days()));
+            Append(buffer, stored.daily_.Aggregates());
+            Append(buffer, stored.daily_.Current());
+        }
+
+        std::filesystem::path temporary = path_;
+        temporary += ".tmp";
+        WriteDurably(temporary, buffer);
+        std::filesystem::rename(temporary, path_);
+        SyncDirectory(path_);
+    }
+
+private:
+    // Writes the whole buffer and waits until it reached the disk, the rename must not get there first
+    static void WriteDurably(const std::filesystem::path& path, const std::string& buffer) {
+#ifdef _WIN32
+        HANDLE file = CreateFileW(path.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+            throw std::runtime_error("Writing cache file failed.");
+        DWORD written = 0;
+        bool ok = WriteFile(file, buffer.data(), static_cast<DWORD>(buffer.size()), &written, nullptr)
+                  && written == buffer.size() && FlushFileBuffers(file);
+        CloseHandle(file);
+#else
+        int file = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (file < 0)
+            throw std::runtime_error("Writing cache file failed.");
+        bool ok = true;
+        for (size_t offset = 0; ok && offset < buffer.size();) {
+            ssize_t written = write(file, buffer.data() + offset, buffer.size() - offset);
+            ok = written > 0;
+            offset += ok ? written : 0;
+        }
+        ok = ok && fsync(file) == 0;
+        ok = close(file) == 0 && ok;
+#endif
+        if (!ok)
+            throw std::runtime_error("Writing cache file failed.");
+    }
+
+    // Makes the rename itself durable. Windows has no directory handles for that, NTFS journals renames.
+    static void SyncDirectory([[maybe_unused]] const std::filesystem::path& path) {
+#ifndef _WIN32
+        std::filesystem::path directory = path.parent_path();
+        int file = open(directory.empty() ? "." : directory.c_str(), O_RDONLY | O_DIRECTORY);
+        if (file < 0)
+            return;
+        fsync(file);
+        close(file);
+#endif
+    }
+
+    struct Reader {
+        std::string_view data_;
+
+        bool Read(void* destination, size_t size) {
+            if (data_.size() < size)
+                return false;
+            std::memcpy(destination, data_.data(), size);
+            data_.remove_prefix(size);
+            return true;
+        }
+
+        template <typename T>
+        bool Read(T& value) {
+            return Read(&value, sizeof(T));
+        }
+
+        bool Read(std::string& value) {
+            uint16_t length = 0;
+            if (!Read(length) || data_.size() < length)
+                return false;
+            value.assign(data_.data(), length);
+            data_.remove_prefix(length);
+            return true;
+        }
+
+        template <typename T>
+        bool Read(std::vector<T>& values, size_t count) {
+            values.resize(count);
+            return count == 0 || Read(values.data(), count * sizeof(T)); // data() of an empty vector may be null
+        }
+    };
+
+    template <typename T>
+    static void Append(std::string& buffer, const T& value) {
+        buffer.append(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    static void Append(std::string& buffer, const std::string& value) {
+        Append(buffer, static_cast<uint16_t>(value.size()));
+        buffer += value;
+    }
+
+    template <typename T>
+    static void Append(std::string& buffer, const std::vector<T>& values) {
+        if (!values.empty())
+            buffer.append(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+    }
+};
@@ -0,0 +1,202 @@
+#pragma once
+
+#include "Fetcher.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstring>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <ostream>
+#include <type_traits>
+
+const uint8_t kExportWorkers = 16;
+const char kExportMagic[4] = {'W', 'F', 'E', 'X'};
+const uint32_t kExportVersion = 1;
+
+const std::string kExportUsage =
+    "Usage: forecast --export [--api-key KEY] [--config PATH] [--format csv|jsonl|binary] [--output PATH]\n"
+    "  --api-key  Api-Ninjas api key, FORECAST_API_KEY by default\n"
+    "  --config   Config file, FORECAST_CONFIG or lib/cfg.json by default\n"
+    "  --format   Output format, csv by default\n"
+    "  --output   Output file, standard output by default\n"
+    "  --record DIR            Save every request and response into DIR\n"
+    "  --replay DIR            Answer requests from a --record directory instead of the network\n"
+    "  --replay-latency MS     Delay added to every replayed request\n"
+    "  --replay-failures RATE  Share of replayed requests failing with 503, 0 to 1\n";
+
+enum class ExportFormat { Csv, JsonLines, Binary };
+
+struct ExportOptions
+{
+    std::string api_key_;
+    std::filesystem::path config_path_;
+    ExportFormat format_ = ExportFormat::Csv;
+    std::filesystem::path output_; // empty - standard output
+    std::filesystem::path record_directory_;
+    std::filesystem::path replay_directory_;
+    std::chrono::milliseconds replay_latency_{0};
+    double replay_failure_rate_ = 0;
+
+    // Reads the options of the headless mode, missing ones come from the environment
+    static ExportOptions FromArguments(int argc, char* argv[]) {
+        ExportOptions options;
+        if (const char* api_key = std::getenv("FORECAST_API_KEY"))
+            options.api_key_ = api_key;
+        if (const char* config = std::getenv("FORECAST_CONFIG"))
+            options.config_path_ = config;
+        else
+            options.config_path_ = DefaultConfigPath();
+
+        for (int i = 1; i < argc; ++i) {
+            std::string argument = argv[i];
+            if (argument == "--export")
+                continue;
+            if (i + 1 == argc)
+                throw std::invalid_argument("Missing value for " + argument + ".");
+            std::string value = argv[++i];
+            if (argument == "--api-key") {
+                options.api_key_ = value;
+            } else if (argument == "--config") {
+                options.config_path_ = value;
+            } else if (argument == "--output") {
+                options.output_ = value;
+            } else if (argument == "--record") {
+                options.record_directory_ = value;
+            } else if (argument == "--replay") {
+                options.replay_directory_ = value;
+            } else if (argument == "--replay-latency") {
+                options.replay_latency_ = std::chrono::milliseconds(std::stoll(value));
+            } else if (argument == "--replay-failures") {
+                options.replay_failure_rate_ = std::stod(value);
+            } else if (argument == "--format") {
+                if (value == "csv")
+                    options.format_ = ExportFormat::Csv;
+                else if (value == "jsonl")
+                    options.format_ = ExportFormat::JsonLines;
+                else if (value == "binary")
+                    options.format_ = ExportFormat::Binary;
+                else
+                    throw std::invalid_argument("Unknown format " + value + ".");
+            } else {
+                throw std::invalid_argument("Unknown argument " + argument + ".");
+            }
+        }
+        if (options.api_key_.empty() && options.replay_directory_.empty())
+            throw std::invalid_argument("Empty api key.");
+        return options;
+    }
+
+    std::shared_ptr<Transport> MakeTransport() const {
+        std::shared_ptr<Transport> transport;
+        if (!replay_directory_.empty())
+            transport = std::make_shared<ReplayTransport>(replay_directory_, replay_latency_, replay_failure_rate_);
+        else
+            transport = std::make_shared<CprTransport>();
+        if (!record_directory_.empty())
+            transport = std::make_shared<RecordingTransport>(transport, record_directory_);
+        // Replays have no quota, but their injected failures are retried like live ones
+        return std::make_shared<SchedulingTransport>(transport, replay_directory_.empty() ? kDefaultRateLimit : kNoRateLimit);
+    }
+};
+
+// Writes day part summaries, one record per (city, day, day part).
+//
+// Binary layout (little-endian on every machine, IEEE 754 floats, no padding):
+//   header: magic "WFEX", u32 version
+//   record: u16 city length, city, char date[10], u8 day part,
+//           f32 min, mean, max of temperature, apparent temperature, wind speed and humidity,
+//           u8 weather code
+class Exporter
+{
+private:
+    std::ostream& out_;
+    ExportFormat format_;
+
+public:
+    Exporter(std::ostream& out, ExportFormat format)
+        : out_(out)
+        , format_(format)
+    {
+        if (format_ == ExportFormat::Csv) {
+            out_ << "city,date,day_part";
+            for (const char* variable : {"temperature", "apparent_temperature", "windspeed", "humidity"})
+                out_ << ',' << variable << "_min," << variable << "_mean," << variable << "_max";
+            out_ << ",weathercode\n";
+        } else if (format_ == ExportFormat::Binary) {
+            out_.write(kExportMagic, sizeof(kExportMagic));
+            Write(kExportVersion);
+        }
+    }
+
+    void Write(const std::string& city, const ForecastData& forecast) {
+        for (size_t day = 0; day < forecast.Days(); ++day) {
+            for (uint8_t part = 0; part < kDayParts; ++part) {
+                uint8_t code = forecast.WeatherCode(day * kHoursPerDay + kDayPartHours[part].second);
+                if (format_ == ExportFormat::Csv)
+                    WriteCsv(city, forecast, day, static_cast<DayPart>(part), code);
+                else if (format_ == ExportFormat::JsonLines)
+                    WriteJson(city, forecast, day, static_cast<DayPart>(part), code);
+                else
+                    WriteBinary(city, forecast, day, static_cast<DayPart>(part), code);
+            }
+        }
+    }
+
+private:
+    void WriteCsv(const std::string& city, const ForecastData& forecast, size_t day, DayPart part, uint8_t code) {
+        // Quote the city, names like "Washington, D.C." contain commas
+        out_ << '"';
+        for (char c : city)
+            out_ << (c == '"' ? "\"\"" : std::string(1, c));
+        out_ << "\"," << forecast.Date(day) << ',' << kDayPartNames[static_cast<uint8_t>(part)];
+        for (uint8_t variable = 0; variable < kVariables; ++variable) {
+            const Summary& summary = forecast.summaries_.Get(day, part, static_cast<Variable>(variable));
+            out_ << ',' << summary.min_ << ',' << summary.mean_ << ',' << summary.max_;
+        }
+        out_ << ',' << int(code) << '\n';
+    }
+
+    void WriteJson(const std::string& city, const ForecastData& forecast, size_t day, DayPart part, uint8_t code) {
+        json record = {{"city", city}, {"date", forecast.Date(day)}, {"day_part", kDayPartNames[static_cast<uint8_t>(part)]}};
+        const char* names[kVariables] = {"temperature", "apparent_temperature", "windspeed", "humidity"};
+        for (uint8_t variable = 0; variable < kVariables; ++variable) {
+            const Summary& summary = forecast.summaries_.Get(day, part, static_cast<Variable>(variable));
+            record[names[variable]] = {{"min", Round(summary.min_)}, {"mean", Round(summary.mean_)}, {"max", Round(summary.max_)}};
+        }
+        record["weathercode"] = code;
+        out_ << record.dump() << '\n';
+    }
+
+    void WriteBinary(const std::string& city, const ForecastData& forecast, size_t day, DayPart part, uint8_t code) {
+        Write(static_cast<uint16_t>(city.size()));
+        out_.write(city.data(), city.size());
+        out_.write(forecast.Date(day).data(), kDateLength);
+        Write(static_cast<uint8_t>(part));
+        for (uint8_t variable = 0; variable < kVariables; ++variable) {
+            const Summary& summary = forecast.summaries_.Get(day, part, static_cast<Variable>(variable));
+            Write(summary.min_);
+            Write(summary.mean_);
+            Write(summary.max_);
+        }
+        Write(code);
+    }
+
+    // Keeps float noise like 19.799999237 out of the json
+    static double Round(float value) {
+        return std::round(static_cast<double>(value) * 100) / 100;
+    }
+
+    // Little-endian whatever the machine is, floats as their IEEE 754 bits
+    template <typename T>
+    void Write(const T& value) {
+        static_assert(std::is_arithmetic_v<T> && std::numeric_limits<float>::is_iec559);
+        char bytes[sizeof(T)];
+        std::memcpy(bytes, &value, sizeof(T));
+        if constexpr (std::endian::native == std::endian::big)
+            std::reverse(std::begin(bytes), std::end(bytes));
+        out_.write(bytes, sizeof(T));
+    }
+};
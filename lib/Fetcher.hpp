@@ -0,0 +1,370 @@
+#pragma once
+
+#include "Weather.hpp"
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <unordered_set>
+
+const uint8_t kMaxConcurrentFetches = 4;
+const std::chrono::seconds kRefreshRetry{300}; // after a failed download, a stale forecast is kept meanwhile
+const std::chrono::seconds kRefreshCheck{60}; // longest sleep of the refresh thread
+
+// Downloads forecasts of the cities in the background on a fixed number of worker threads.
+// A refresh thread queues every prefetched city again shortly before its forecast expires.
+// Every city is queued with the view it is needed for. A detail download also updates the daily aggregates,
+// the current conditions come with overview downloads only.
+// A worker makes one request per turn: cities are geocoded one at a time and move on to the located
+// queue, whose forecasts go out in batches. So requested cities and shutdown wait for a single request at most.
+class Fetcher
+{
+private:
+    Weather& weather_;
+    std::vector<std::thread> workers_;
+    std::thread refresher_;
+    using Watched = std::vector<std::pair<std::string, View>>;
+    std::shared_ptr<const Watched> watched_ = std::make_shared<const Watched>(); // what the refresh thread keeps fresh
+    std::vector<std::string> prefetched_; // in the order of the Prefetch calls
+    std::unordered_map<std::string, View> prefetched_views_;
+    std::unordered_set<std::string> focus_; // detail view kept fresh, see Focus
+    std::unordered_map<std::string, std::chrono::system_clock::time_point> retry_after_; // failed downloads
+    std::deque<std::string> queue_; // coordinates unknown
+    std::deque<std::string> located_; // waiting for the forecast
+    std::unordered_map<std::string, View> pending_; // queued, being geocoded or downloaded, with the view
+    std::unordered_set<std::string> urgent_; // queued by Request, downloaded with Priority::Interactive
+    std::unordered_map<std::string, bool> upgrades_; // overviews being downloaded whose detail is needed -> urgent
+    std::unordered_map<std::string, std::string> errors_;
+    std::function<void(const std::vector<std::string>&)> on_update_;
+    std::mutex mutex_;
+    std::mutex update_mutex_;
+    std::condition_variable has_work_;
+    std::condition_variable idle_;
+    std::condition_variable stopped_;
+    bool stopping_ = false;
+
+public:
+    Fetcher(Weather& weather, uint8_t num_workers = kMaxConcurrentFetches)
+        : weather_(weather)
+    {
+        for (uint8_t i = 0; i < num_workers; ++i)
+            workers_.emplace_back([this] { Work(); });
+        refresher_ = std::thread([this] { Refresh(); });
+    }
+
+    ~Fetcher() {
+        {
+            std::lock_guard lock(mutex_);
+            stopping_ = true;
+        }
+        has_work_.notify_all();
+        stopped_.notify_all();
+        for (auto& worker : workers_)
+            worker.join();
+        refresher_.join();
+    }
+
+    // Queues every city in order and keeps the fields of `view` fresh from then on. Cities watched already
+    // are queued again if they aren't pending, but watched once, with the detail view if either call asked for it.
+    void Prefetch(const std::vector<std::string>& cities, View view = View::Overview) {
+        {
+            std::lock_guard lock(mutex_);
+            for (const auto& city : cities) {
+                Enqueue(city, view);
+                auto [watched, inserted] = prefetched_views_.try_emplace(city, view);
+                if (inserted)
+                    prefetched_.push_back(city);
+                else if (view == View::Detail)
+                    watched->second = View::Detail;
+            }
+            UpdateWatched();
+        }
+        has_work_.notify_all();
+    }
+
+    // Queues the detail view of the cities and keeps it fresh instead of their overview, e.g. for the city
+    // on screen. Replaces the cities of the previous call, those go back to what Prefetch asked for.
+    void Focus(const std::vector<std::string>& cities) {
+        {
+            std::lock_guard lock(mutex_);
+            for (const auto& city : cities)
+                Enqueue(city, View::Detail);
+            focus_ = std::unordered_set<std::string>(cities.begin(), cities.end());
+            UpdateWatched();
+        }
+        has_work_.notify_all();
+    }
+
+    // Puts the detail view of the city in front of the queue, e.g. because it is on screen
+    void Request(const std::string& city) {
+        {
+            std::lock_guard lock(mutex_);
+            auto [pending, inserted] = pending_.try_emplace(city, View::Detail);
+            if (!inserted && !Unqueue(city)) {
+                // Already being downloaded, an overview is followed by the detail view.
+                // A city being geocoded goes out alone once it is located.
+                if (pending->second == View::Overview)
+                    upgrades_[city] = true;
+                else
+                    urgent_.insert(city);
+                return;
+            }
+            pending->second = View::Detail;
+            (weather_.IsLocated(city) ? located_ : queue_).push_front(city);
+            urgent_.insert(city);
+        }
+        has_work_.notify_one();
+    }
+
+    bool IsPending(const std::string& city) {
+        std::lock_guard lock(mutex_);
+        return pending_.contains(city);
+    }
+
+    // False while a failed city waits for its retry time
+    bool IsRetryDue(const std::string& city) {
+        std::lock_guard lock(mutex_);
+        auto retry = retry_after_.find(city);
+        return retry == retry_after_.end() || retry->second <= std::chrono::system_clock::now();
+    }
+
+    // Moment a failed city may be requested again
+    std::optional<std::chrono::system_clock::time_point> RetryAfter(const std::string& city) {
+        std::lock_guard lock(mutex_);
+        auto retry = retry_after_.find(city);
+        if (retry == retry_after_.end())
+            return std::nullopt;
+        return retry->second;
+    }
+
+    std::optional<std::string> GetError(const std::string& city) {
+        std::lock_guard lock(mutex_);
+        auto error = errors_.find(city);
+        if (error == errors_.end())
+            return std::nullopt;
+        return error->second;
+    }
+
+    // Blocks until every queued city is downloaded or has failed
+    void Wait() {
+        std::unique_lock lock(mutex_);
+        idle_.wait(lock, [this] { return pending_.empty(); });
+    }
+
+    // Called from a worker thread with the cities of each finished batch, one call at a time
+    void SetOnUpdate(std::function<void(const std::vector<std::string>&)> on_update) {
+        std::lock_guard lock(update_mutex_);
+        on_update_ = std::move(on_update);
+    }
+
+private:
+    void Work() {
+        while (true) {
+            std::vector<std::string> batch;
+            Priority priority = Priority::Background;
+            View view = View::Overview;
+            bool geocode = false;
+            {
+                std::unique_lock lock(mutex_);
+                has_work_.wait(lock, [this] { return stopping_ || !queue_.empty() || !located_.empty(); });
+                if (stopping_)
+                    return;
+                // Requested cities sit in front of the queues and go out alone, ahead of the prefetches.
+                // Forecasts wait for a full batch while there are cities left to geocode, then the rest
+                // is split evenly between the workers.
+                std::deque<std::string>* source = &located_;
+                size_t count = queue_.empty() ? std::clamp<size_t>(located_.size() / workers_.size(), 1, kForecastBatchSize)
+                                              : kForecastBatchSize;
+                if (!located_.empty() && urgent_.contains(located_.front())) {
+                    priority = Priority::Interactive;
+                    count = 1;
+                } else if (!queue_.empty() && urgent_.contains(queue_.front())) {
+                    // Geocoded and downloaded in one go
+                    source = &queue_;
+                    priority = Priority::Interactive;
+                    count = 1;
+                } else if (located_.size() < count) {
+                    source = &queue_;
+                    geocode = true;
+                    count = 1;
+                }
+                view = pending_.at(source->front());
+                while (batch.size() < count && !source->empty() && pending_.at(source->front()) == view) {
+                    urgent_.erase(source->front());
+                    batch.push_back(std::move(source->front()));
+                    source->pop_front();
+                }
+            }
+
+            std::vector<std::pair<std::string, std::string>> errors;
+            if (geocode) {
+                std::optional<std::string> error = weather_.Geocode(batch.front(), priority);
+                if (!error) {
+                    MoveToLocated(batch.front());
+                    continue;
+                }
+                errors.emplace_back(batch.front(), *error);
+            } else {
+                try {
+                    errors = weather_.FetchMany(batch, priority, view);
+                } catch (const std::exception& e) {
+                    for (const auto& city : batch)
+                        errors.emplace_back(city, e.what());
+                }
+            }
+
+            std::unordered_set<std::string> failed;
+            {
+                std::lock_guard lock(mutex_);
+                auto retry_at = std::chrono::system_clock::now() + kRefreshRetry;
+                for (const auto& city : batch) {
+                    errors_.erase(city);
+                    retry_after_.erase(city);
+                }
+                for (const auto& [city, error] : errors) {
+                    errors_[city] = error;
+                    retry_after_[city] = retry_at;
+                    failed.insert(city);
+                }
+            }
+            {
+                std::lock_guard lock(update_mutex_);
+                if (on_update_)
+                    on_update_(batch);
+            }
+            // Cities stay pending until the update went out, so Wait covers it
+            bool idle = false;
+            bool upgraded = false;
+            {
+                std::lock_guard lock(mutex_);
+                for (const auto& city : batch) {
+                    urgent_.erase(city);
+                    auto upgrade = upgrades_.find(city);
+                    // A failed city waits for its retry time, even if its detail view was asked for
+                    if (upgrade == upgrades_.end() || failed.contains(city)) {
+                        if (upgrade != upgrades_.end())
+                            upgrades_.erase(upgrade);
+                        pending_.erase(city);
+                        continue;
+                    }
+                    pending_[city] = View::Detail;
+                    if (upgrade->second) {
+                        located_.push_front(city);
+                        urgent_.insert(city);
+                    } else {
+                        located_.push_back(city);
+                    }
+                    upgrades_.erase(upgrade);
+                    upgraded = true;
+                }
+                idle = pending_.empty();
+            }
+            if (upgraded)
+                has_work_.notify_all();
+            // Persist what was downloaded once the queue runs dry
+            if (idle) {
+                weather_.SaveCache();
+                idle_.notify_all();
+            }
+        }
+    }
+
+    // A geocoded city waits for its forecast, requested meanwhile it goes out next
+    void MoveToLocated(const std::string& city) {
+        {
+            std::lock_guard lock(mutex_);
+            auto upgrade = upgrades_.find(city);
+            if (upgrade != upgrades_.end()) {
+                pending_[city] = View::Detail;
+                if (upgrade->second)
+                    urgent_.insert(city);
+                upgrades_.erase(upgrade);
+            }
+            if (urgent_.contains(city))
+                located_.push_front(city);
+            else
+                located_.push_back(city);
+        }
+        has_work_.notify_one();
+    }
+
+    // Expects mutex_ to be held. Returns whether the city was added to a queue, a queued overview
+    // becomes a detail download instead and one being downloaded is followed by one.
+    bool Enqueue(const std::string& city, View view) {
+        auto [pending, inserted] = pending_.try_emplace(city, view);
+        if (inserted) {
+            (weather_.IsLocated(city) ? located_ : queue_).push_back(city);
+            return true;
+        }
+        if (view == View::Detail && pending->second == View::Overview) {
+            if (IsQueued(city))
+                pending->second = View::Detail;
+            else
+                upgrades_.try_emplace(city, false);
+        }
+        return false;
+    }
+
+    // Expects mutex_ to be held. The refresh thread reads the list unlocked, so it is replaced instead of changed.
+    void UpdateWatched() {
+        auto watched = std::make_shared<Watched>();
+        watched->reserve(prefetched_.size() + focus_.size());
+        for (const auto& city : prefetched_)
+            watched->emplace_back(city, focus_.contains(city) ? View::Detail : prefetched_views_.at(city));
+        for (const auto& city : focus_) {
+            if (!prefetched_views_.contains(city))
+                watched->emplace_back(city, View::Detail);
+        }
+        watched_ = std::move(watched);
+    }
+
+    // Expects mutex_ to be held
+    bool IsQueued(const std::string& city) const {
+        return std::find(queue_.begin(), queue_.end(), city) != queue_.end()
+               || std::find(located_.begin(), located_.end(), city) != located_.end();
+    }
+
+    // Expects mutex_ to be held. Takes the city out of the queue it waits in, false if it isn't queued.
+    bool Unqueue(const std::string& city) {
+        for (std::deque<std::string>* queue : {&queue_, &located_}) {
+            auto queued = std::find(queue->begin(), queue->end(), city);
+            if (queued != queue->end()) {
+                queue->erase(queued);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void Refresh() {
+        std::unique_lock lock(mutex_);
+        while (!stopping_) {
+            // The scan runs unlocked on the list as it was, see UpdateWatched
+            std::shared_ptr<const Watched> watched = watched_;
+            lock.unlock();
+            std::optional<std::chrono::system_clock::time_point> next;
+            std::vector<std::pair<std::string, View>> due = weather_.DueForRefresh(*watched, next);
+            lock.lock();
+
+            auto now = std::chrono::system_clock::now();
+            bool queued = false;
+            for (const auto& [city, view] : due) {
+                auto retry = retry_after_.find(city);
+                if (retry != retry_after_.end() && retry->second > now) {
+                    if (!next || retry->second < *next)
+                        next = retry->second;
+                    continue;
+                }
+                queued |= Enqueue(city, view);
+            }
+            if (queued)
+                has_work_.notify_all();
+
+            auto wake = now + kRefreshCheck;
+            if (next && *next < wake)
+                wake = *next;
+            stopped_.wait_until(lock, wake);
+        }
+    }
+};
@@ -3,9 +3,19 @@
 #include "API.hpp"
 #include "Config.hpp"
 #include "Console.hpp"
+#include "Export.hpp"
+#include "Fetcher.hpp"
 #include "Weather.hpp"
+#include <chrono>
+#include <cstdio>
+#include <future>
 #include <iostream>
 
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
 class Forecast
 {
 private:
@@ -18,18 +28,128 @@ public:
     Forecast() {};
 
     void Start() {
-        std::pair<std::string, std::string> data = printer.GetUserInfo();
+        auto fetcher = std::make_unique<Fetcher>(weather);
+        // While the api key is typed: connect to both APIs, read the default config and its cache, and download
+        // the cities whose coordinates are cached, those need no key
+        auto warm = std::async(std::launch::async, [this] { weather.Warm(); });
+        auto speculative = std::async(std::launch::async, [this, &fetcher] { return Speculate(DefaultConfigPath(), *fetcher); });
+
+        std::optional<std::pair<std::string, std::string>> data = printer.GetUserInfo();
+        // The time to the first table is counted from here, typing doesn't belong to it
+        auto started = std::chrono::steady_clock::now();
+        std::optional<Config> default_cfg = speculative.get();
+        if (!data)
+            return;
+
+        std::string api_key = data->first;
+        std::filesystem::path cfg_path = data->second;
+        weather.SetApiKey(api_key);
 
-        std::string api_key = data.first;
-        std::filesystem::path cfg_path = data.second;
-        
-        Weather weather(cfg_path, api_key);
-        ConfigParser config_parser(cfg_path);
+        if (default_cfg && cfg_path == DefaultConfigPath()) {
+            cfg = std::move(*default_cfg);
+        } else {
+            ConfigParser config_parser(cfg_path);
+            config_parser.Parse();
+            cfg = config_parser.GetConfig();
+            if (default_cfg) {
+                // The default config's cities would be kept fresh and saved into this config's cache
+                fetcher = std::make_unique<Fetcher>(weather);
+                weather.ClearCache();
+            }
+            weather.SetCacheTTL(cfg.cache_ttl_);
+            weather.LoadCache(cfg.cache_path_);
+        }
+        if (!cfg.stats_path_.empty())
+            Stats::Enable();
+        // Download every city while the first one is shown, the prefetched ones are fresh already
+        fetcher->Prefetch(cfg.cities_);
+        printer.SetConfig(cfg);
+        printer.PrintResults(weather, *fetcher, started);
+        fetcher.reset();
+        weather.SaveCache();
+        if (!cfg.stats_path_.empty())
+            Stats::Dump(cfg.stats_path_);
+    }
+
+    // Work on a config before it is known to be the one used, empty if it can't be read
+    std::optional<Config> Speculate(const std::filesystem::path& path, Fetcher& fetcher) {
+        try {
+            ConfigParser config_parser(path);
+            config_parser.Parse();
+            Config config = config_parser.GetConfig();
+            weather.SetCacheTTL(config.cache_ttl_);
+            weather.LoadCache(config.cache_path_);
+            std::vector<std::string> located = weather.Located(config.cities_);
+            // The first city is shown first, its table needs the hours
+            if (!located.empty() && located.front() == config.cities_.front())
+                fetcher.Request(located.front());
+            fetcher.Prefetch(located);
+            return config;
+        } catch (const std::exception&) {
+            return std::nullopt;
+        }
+    }
+
+    // Headless mode: downloads every city of the config and writes day part summaries without the UI.
+    // Returns the process exit code.
+    int Export(const ExportOptions& options) {
+        Weather weather(options.config_path_, options.api_key_);
+        weather.SetTransport(options.MakeTransport());
+        ConfigParser config_parser(options.config_path_);
 
         config_parser.Parse();
         cfg = config_parser.GetConfig();
+        weather.SetCacheTTL(cfg.cache_ttl_);
+        if (!cfg.stats_path_.empty())
+            Stats::Enable();
+        weather.LoadCache(cfg.cache_path_);
 
-        printer.SetConfig(cfg);
-        printer.PrintResults(weather);
+        std::ofstream file;
+        if (!options.output_.empty()) {
+            file.open(options.output_, std::ios::binary | std::ios::trunc);
+            if (!file)
+                throw std::invalid_argument("Opening output file failed.");
+        }
+#ifdef _WIN32
+        // Standard output is in text mode, which would write every 0x0A byte of the binary format as 0x0D 0x0A
+        if (options.output_.empty() && options.format_ == ExportFormat::Binary) {
+            std::cout.flush();
+            _setmode(_fileno(stdout), _O_BINARY);
+        }
+#endif
+        Exporter exporter(options.output_.empty() ? std::cout : file, options.format_);
+
+        size_t exported = 0;
+        size_t failed = 0;
+        auto start = std::chrono::steady_clock::now();
+        {
+            Fetcher fetcher(weather, kExportWorkers);
+            // Stream every batch out as soon as it is downloaded
+            fetcher.SetOnUpdate([&](const std::vector<std::string>& cities) {
+                for (const auto& city : cities) {
+                    std::optional<std::string> error = fetcher.GetError(city);
+                    std::optional<ForecastData> forecast = weather.TryGetWeather(city, cfg.num_days_);
+                    if (!error && forecast) {
+                        exporter.Write(city, *forecast);
+                        ++exported;
+                    } else {
+                        std::cerr << city << ": " << error.value_or("No data.") << '\n';
+                        ++failed;
+                    }
+                }
+            });
+            // The summaries are of hours, so every city needs the detail view
+            fetcher.Prefetch(cfg.cities_, View::Detail);
+            fetcher.Wait();
+            fetcher.SetOnUpdate(nullptr);
+        }
+        weather.SaveCache();
+        if (!cfg.stats_path_.empty())
+            Stats::Dump(cfg.stats_path_);
+
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cerr << "Exported " << exported << " cities (" << failed << " failed) in " << seconds << " s, "
+                  << (seconds > 0 ? (exported + failed) / seconds : 0) << " cities/s\n";
+        return failed == 0 ? 0 : 1;
     }
 };
@@ -0,0 +1,400 @@
+#pragma once
+
+#include "Aggregate.hpp"
+#include "Config.hpp"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <vector>
+
+const uint8_t kMissingValue = std::numeric_limits<uint8_t>::max();
+const int16_t kMissingFixed = std::numeric_limits<int16_t>::min();
+const uint16_t kMissingWindspeed = std::numeric_limits<uint16_t>::max();
+const float kFixedScale = 10; // temperatures in 0.1 °C, wind speed in 0.1 km/h, the precision Open-Meteo sends
+const uint8_t kDateLength = 10; // "YYYY-MM-DD"
+
+// Fixed-point conversions of the quantized records, NaN stands for a missing value
+inline int16_t ToFixed(float value) {
+    if (std::isnan(value))
+        return kMissingFixed;
+    return static_cast<int16_t>(std::clamp(std::round(value * kFixedScale), -32767.0f, 32767.0f));
+}
+
+inline float FromFixed(int16_t value) {
+    return value == kMissingFixed ? std::numeric_limits<float>::quiet_NaN() : value / kFixedScale;
+}
+
+inline uint16_t ToFixedWindspeed(float value) {
+    if (std::isnan(value))
+        return kMissingWindspeed;
+    return static_cast<uint16_t>(std::clamp(std::round(value * kFixedScale), 0.0f, 65534.0f));
+}
+
+inline float FromFixedWindspeed(uint16_t value) {
+    return value == kMissingWindspeed ? std::numeric_limits<float>::quiet_NaN() : value / kFixedScale;
+}
+
+// Columns of one location as they are read from a response, packed into ForecastData (hourly)
+// or DailyForecast (daily and current) afterwards. A response has only the ones its view asked for.
+struct ForecastColumns
+{
+    std::vector<float> temperature_;
+    std::vector<float> apparent_temperature_;
+    std::vector<float> windspeed_;
+    std::vector<uint8_t> humidity_;
+    std::vector<uint8_t> weathercode_;
+    std::vector<std::string> dates_; // one per day, "YYYY-MM-DD"
+
+    std::vector<float> temperature_min_;
+    std::vector<float> temperature_max_;
+    std::vector<float> apparent_temperature_min_;
+    std::vector<float> apparent_temperature_max_;
+    std::vector<float> windspeed_max_;
+    std::vector<uint8_t> humidity_mean_;
+    std::vector<uint8_t> daily_weathercode_;
+
+    int32_t utc_offset_seconds_ = 0; // of the location's time zone, the hours and days are local to it
+
+    // Single values of the "current" object, missing ones stay NaN
+    float current_temperature_ = std::numeric_limits<float>::quiet_NaN();
+    float current_windspeed_ = std::numeric_limits<float>::quiet_NaN();
+    float current_humidity_ = std::numeric_limits<float>::quiet_NaN();
+    float current_weathercode_ = std::numeric_limits<float>::quiet_NaN();
+
+    // Every hourly column has an hour for each day
+    bool IsComplete() const {
+        size_t hours = dates_.size() * kHoursPerDay;
+        return !dates_.empty() && temperature_.size() == hours && apparent_temperature_.size() == hours
+               && windspeed_.size() == hours && humidity_.size() == hours && weathercode_.size() == hours;
+    }
+
+    // Every daily column has a value for each day
+    bool HasDaily() const {
+        size_t days = dates_.size();
+        return days != 0 && temperature_min_.size() == days && temperature_max_.size() == days
+               && apparent_temperature_min_.size() == days && apparent_temperature_max_.size() == days
+               && windspeed_max_.size() == days && humidity_mean_.size() == days && daily_weathercode_.size() == days;
+    }
+};
+
+// Forecast of one location, quantized into a single block of 8 bytes per hour and 10 per day:
+//   i16 temperature[hours], i16 apparent temperature[hours], u16 wind speed[hours],
+//   u8 humidity[hours], u8 weather code[hours], char date[days][10]
+// Each variable stays contiguous, missing values are kMissingFixed, kMissingWindspeed or kMissingValue.
+class ForecastData
+{
+private:
+    std::vector<int16_t> block_;
+    uint16_t days_ = 0;
+
+public:
+    DayPartSummaries summaries_; // computed once per response
+
+    ForecastData() {}
+
+    // Expects columns.IsComplete()
+    explicit ForecastData(const ForecastColumns& columns)
+        : ForecastData(static_cast<uint16_t>(columns.dates_.size()))
+    {
+        size_t hours = Hours();
+        for (size_t hour = 0; hour < hours; ++hour) {
+            Temperatures()[hour] = ToFixed(columns.temperature_[hour]);
+            ApparentTemperatures()[hour] = ToFixed(columns.apparent_temperature_[hour]);
+            Windspeeds()[hour] = ToFixedWindspeed(columns.windspeed_[hour]);
+        }
+        std::memcpy(Humidities(), columns.humidity_.data(), hours);
+        std::memcpy(WeatherCodes(), columns.weathercode_.data(), hours);
+        for (size_t day = 0; day < days_; ++day) {
+            std::string date = columns.dates_[day];
+            date.resize(kDateLength, ' ');
+            std::memcpy(Dates() + day * kDateLength, date.data(), kDateLength);
+        }
+        Summarize();
+    }
+
+    // From a block written out with Block(), returns false if its size doesn't fit `days`
+    static bool FromBlock(uint16_t days, std::vector<int16_t> block, ForecastData& data) {
+        if (block.size() != BlockSize(days))
+            return false;
+        data.days_ = days;
+        data.block_ = std::move(block);
+        data.Summarize();
+        return true;
+    }
+
+    const std::vector<int16_t>& Block() const {
+        return block_;
+    }
+
+    static size_t BlockSize(size_t days) {
+        return 4 * days * kHoursPerDay + days * kDateLength / 2;
+    }
+
+    size_t Days() const {
+        return days_;
+    }
+
+    size_t Hours() const {
+        return days_ * kHoursPerDay;
+    }
+
+    float Temperature(size_t hour) const {
+        return FromFixed(Temperatures()[hour]);
+    }
+
+    float ApparentTemperature(size_t hour) const {
+        return FromFixed(ApparentTemperatures()[hour]);
+    }
+
+    float Windspeed(size_t hour) const {
+        return FromFixedWindspeed(Windspeeds()[hour]);
+    }
+
+    uint8_t Humidity(size_t hour) const {
+        return Humidities()[hour];
+    }
+
+    uint8_t WeatherCode(size_t hour) const {
+        return WeatherCodes()[hour];
+    }
+
+    std::string_view Date(size_t day) const {
+        return {Dates() + day * kDateLength, kDateLength};
+    }
+
+    // Heap and inline bytes held by the forecast, summaries included
+    size_t MemoryUsage() const {
+        return sizeof(ForecastData) + block_.capacity() * sizeof(int16_t) + summaries_.MemoryUsage();
+    }
+
+    // Builds the block from an Open-Meteo response, missing values stay missing
+    static ForecastData FromJson(const json& forecast) {
+        ForecastColumns columns;
+        const json& hourly = forecast.at("hourly");
+        FillFloats(hourly.at("temperature_2m"), columns.temperature_);
+        FillFloats(hourly.at("apparent_temperature"), columns.apparent_temperature_);
+        FillFloats(hourly.at("windspeed_10m"), columns.windspeed_);
+        FillBytes(hourly.at("relativehumidity_2m"), columns.humidity_);
+        FillBytes(hourly.at("weathercode"), columns.weathercode_);
+
+        const json& dates = forecast.at("daily").at("time");
+        columns.dates_.reserve(dates.size());
+        for (const auto& date : dates)
+            columns.dates_.push_back(date.get<std::string>());
+
+        if (!columns.IsComplete())
+            throw std::invalid_argument("Unexpected forecast response.");
+        return ForecastData(columns);
+    }
+
+    // (Re)computes summaries_ from the hourly columns, reading the fixed-point values directly
+    void Summarize() {
+        size_t hours = Hours();
+        summaries_ = DayPartSummaries(Days());
+        summaries_.Aggregate(Temperatures(), hours, Variable::Temperature, kMissingFixed, 1 / kFixedScale);
+        summaries_.Aggregate(ApparentTemperatures(), hours, Variable::ApparentTemperature, kMissingFixed, 1 / kFixedScale);
+        summaries_.Aggregate(Windspeeds(), hours, Variable::Windspeed, kMissingWindspeed, 1 / kFixedScale);
+        summaries_.Aggregate(Humidities(), hours, Variable::Humidity, kMissingValue, 1.0f);
+    }
+
+    // Copy holding only the first `days` days
+    ForecastData Slice(size_t days) const {
+        ForecastData data(static_cast<uint16_t>(std::min(days, Days())));
+        size_t hours = data.Hours();
+        std::memcpy(data.Temperatures(), Temperatures(), hours * sizeof(int16_t));
+        std::memcpy(data.ApparentTemperatures(), ApparentTemperatures(), hours * sizeof(int16_t));
+        std::memcpy(data.Windspeeds(), Windspeeds(), hours * sizeof(uint16_t));
+        std::memcpy(data.Humidities(), Humidities(), hours);
+        std::memcpy(data.WeatherCodes(), WeatherCodes(), hours);
+        std::memcpy(data.Dates(), Dates(), data.Days() * kDateLength);
+        data.summaries_ = summaries_.Slice(data.Days());
+        return data;
+    }
+
+private:
+    explicit ForecastData(uint16_t days)
+        : block_(BlockSize(days))
+        , days_(days)
+    {}
+
+    // Column offsets, the byte columns and the dates follow the three 16-bit ones
+    int16_t* Temperatures() { return block_.data(); }
+    const int16_t* Temperatures() const { return block_.data(); }
+    int16_t* ApparentTemperatures() { return block_.data() + Hours(); }
+    const int16_t* ApparentTemperatures() const { return block_.data() + Hours(); }
+    uint16_t* Windspeeds() { return reinterpret_cast<uint16_t*>(block_.data() + 2 * Hours()); }
+    const uint16_t* Windspeeds() const { return reinterpret_cast<const uint16_t*>(block_.data() + 2 * Hours()); }
+    uint8_t* Humidities() { return reinterpret_cast<uint8_t*>(block_.data() + 3 * Hours()); }
+    const uint8_t* Humidities() const { return reinterpret_cast<const uint8_t*>(block_.data() + 3 * Hours()); }
+    uint8_t* WeatherCodes() { return Humidities() + Hours(); }
+    const uint8_t* WeatherCodes() const { return Humidities() + Hours(); }
+    char* Dates() { return reinterpret_cast<char*>(WeatherCodes() + Hours()); }
+    const char* Dates() const { return reinterpret_cast<const char*>(WeatherCodes() + Hours()); }
+
+    static void FillFloats(const json& values, std::vector<float>& result) {
+        result.reserve(values.size());
+        for (const auto& value : values)
+            result.push_back(value.is_number() ? value.get<float>() : std::numeric_limits<float>::quiet_NaN());
+    }
+
+    static void FillBytes(const json& values, std::vector<uint8_t>& result) {
+        result.reserve(values.size());
+        for (const auto& value : values)
+            result.push_back(value.is_number() ? value.get<uint8_t>() : kMissingValue);
+    }
+};
+
+// Aggregates of a whole day, quantized the same way as ForecastData
+struct DayAggregates
+{
+    int16_t temperature_min_ = kMissingFixed;
+    int16_t temperature_max_ = kMissingFixed;
+    int16_t apparent_temperature_min_ = kMissingFixed;
+    int16_t apparent_temperature_max_ = kMissingFixed;
+    uint16_t windspeed_max_ = kMissingWindspeed;
+    uint8_t humidity_mean_ = kMissingValue;
+    uint8_t weathercode_ = kMissingValue; // the most severe of the day
+    char date_[kDateLength] = {};
+};
+static_assert(sizeof(DayAggregates) == 22, "DayAggregates is written to the disk cache as it is in memory");
+
+// Conditions at the time of the download
+struct CurrentConditions
+{
+    int16_t temperature_ = kMissingFixed;
+    uint16_t windspeed_ = kMissingWindspeed;
+    uint8_t humidity_ = kMissingValue;
+    uint8_t weathercode_ = kMissingValue;
+};
+static_assert(sizeof(CurrentConditions) == 6, "CurrentConditions is written to the disk cache as it is in memory");
+
+// Overview of a location: one record of aggregates per day plus the current conditions,
+// from Open-Meteo's daily aggregates or computed from an hourly ForecastData
+class DailyForecast
+{
+private:
+    std::vector<DayAggregates> days_;
+    CurrentConditions current_;
+
+public:
+    DailyForecast() {}
+
+    DailyForecast(std::vector<DayAggregates> days, CurrentConditions current)
+        : days_(std::move(days))
+        , current_(current)
+    {}
+
+    // Expects columns.HasDaily()
+    explicit DailyForecast(const ForecastColumns& columns) {
+        days_.resize(columns.dates_.size());
+        for (size_t day = 0; day < days_.size(); ++day) {
+            DayAggregates& aggregates = days_[day];
+            aggregates.temperature_min_ = ToFixed(columns.temperature_min_[day]);
+            aggregates.temperature_max_ = ToFixed(columns.temperature_max_[day]);
+            aggregates.apparent_temperature_min_ = ToFixed(columns.apparent_temperature_min_[day]);
+            aggregates.apparent_temperature_max_ = ToFixed(columns.apparent_temperature_max_[day]);
+            aggregates.windspeed_max_ = ToFixedWindspeed(columns.windspeed_max_[day]);
+            aggregates.humidity_mean_ = columns.humidity_mean_[day];
+            aggregates.weathercode_ = columns.daily_weathercode_[day];
+            std::memcpy(aggregates.date_, columns.dates_[day].data(), std::min<size_t>(kDateLength, columns.dates_[day].size()));
+        }
+        current_.temperature_ = ToFixed(columns.current_temperature_);
+        current_.windspeed_ = ToFixedWindspeed(columns.current_windspeed_);
+        current_.humidity_ = ToByte(columns.current_humidity_);
+        current_.weathercode_ = ToByte(columns.current_weathercode_);
+    }
+
+    // Aggregates of every day of an hourly forecast. There is no current hour without the time zone,
+    // so the current conditions stay missing.
+    static DailyForecast FromHourly(const ForecastData& forecast) {
+        std::vector<DayAggregates> days(forecast.Days());
+        for (size_t day = 0; day < days.size(); ++day) {
+            float temperature_min = std::numeric_limits<float>::quiet_NaN();
+            float temperature_max = std::numeric_limits<float>::quiet_NaN();
+            float apparent_min = std::numeric_limits<float>::quiet_NaN();
+            float apparent_max = std::numeric_limits<float>::quiet_NaN();
+            float windspeed_max = std::numeric_limits<float>::quiet_NaN();
+            uint32_t humidity_sum = 0;
+            uint8_t humidity_count = 0;
+            uint8_t weathercode = kMissingValue;
+            for (size_t hour = day * kHoursPerDay; hour < (day + 1) * kHoursPerDay; ++hour) {
+                // fmin and fmax skip the missing values
+                temperature_min = std::fmin(temperature_min, forecast.Temperature(hour));
+                temperature_max = std::fmax(temperature_max, forecast.Temperature(hour));
+                apparent_min = std::fmin(apparent_min, forecast.ApparentTemperature(hour));
+                apparent_max = std::fmax(apparent_max, forecast.ApparentTemperature(hour));
+                windspeed_max = std::fmax(windspeed_max, forecast.Windspeed(hour));
+                if (forecast.Humidity(hour) != kMissingValue) {
+                    humidity_sum += forecast.Humidity(hour);
+                    ++humidity_count;
+                }
+                uint8_t code = forecast.WeatherCode(hour);
+                if (code != kMissingValue && (weathercode == kMissingValue || code > weathercode))
+                    weathercode = code;
+            }
+            DayAggregates& aggregates = days[day];
+            aggregates.temperature_min_ = ToFixed(temperature_min);
+            aggregates.temperature_max_ = ToFixed(temperature_max);
+            aggregates.apparent_temperature_min_ = ToFixed(apparent_min);
+            aggregates.apparent_temperature_max_ = ToFixed(apparent_max);
+            aggregates.windspeed_max_ = ToFixedWindspeed(windspeed_max);
+            aggregates.humidity_mean_ = humidity_count > 0 ? static_cast<uint8_t>((humidity_sum + humidity_count / 2) / humidity_count)
+                                                           : kMissingValue;
+            aggregates.weathercode_ = weathercode;
+            std::memcpy(aggregates.date_, forecast.Date(day).data(), kDateLength);
+        }
+        return DailyForecast(std::move(days), {});
+    }
+
+    size_t Days() const {
+        return days_.size();
+    }
+
+    const std::vector<DayAggregates>& Aggregates() const {
+        return days_;
+    }
+
+    const CurrentConditions& Current() const {
+        return current_;
+    }
+
+    // Only overview downloads have current conditions
+    bool HasCurrent() const {
+        return current_.temperature_ != kMissingFixed;
+    }
+
+    float TemperatureMin(size_t day) const {
+        return FromFixed(days_[day].temperature_min_);
+    }
+
+    float TemperatureMax(size_t day) const {
+        return FromFixed(days_[day].temperature_max_);
+    }
+
+    float WindspeedMax(size_t day) const {
+        return FromFixedWindspeed(days_[day].windspeed_max_);
+    }
+
+    float CurrentTemperature() const {
+        return FromFixed(current_.temperature_);
+    }
+
+    float CurrentWindspeed() const {
+        return FromFixedWindspeed(current_.windspeed_);
+    }
+
+    size_t MemoryUsage() const {
+        return sizeof(DailyForecast) + days_.capacity() * sizeof(DayAggregates);
+    }
+
+private:
+    static uint8_t ToByte(float value) {
+        if (std::isnan(value))
+            return kMissingValue;
+        return static_cast<uint8_t>(std::clamp(value, 0.0f, 254.0f));
+    }
+};
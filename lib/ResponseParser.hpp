@@ -0,0 +1,326 @@
+#pragma once
+
+#include "ForecastData.hpp"
+
+#include <optional>
+#include <stdexcept>
+#include <string_view>
+
+// Streaming (SAX) parsers for the API responses. They write values straight into their
+// destination without building a json DOM and skip every field that isn't shown.
+
+// Fills ForecastColumns from an Open-Meteo forecast response: the hourly and daily arrays and
+// the single values of "current", whichever the request asked for. Both the old (windspeed_10m)
+// and the current (wind_speed_10m) variable names are read. Responses for several locations
+// are an array of the same objects, one per location.
+class ForecastParser
+{
+private:
+    std::vector<ForecastColumns> forecasts_;
+    int depth_ = 0;
+    int base_ = 0; // 1 if the forecasts are inside a top level array
+    bool in_hourly_ = false;
+    bool in_daily_ = false;
+    bool in_current_ = false;
+    bool reading_reason_ = false;
+    bool reading_utc_offset_ = false;
+    float* current_ = nullptr; // value of "current" being read
+    std::vector<float>* floats_ = nullptr; // array being read, at most one is set
+    std::vector<uint8_t>* bytes_ = nullptr;
+    std::vector<std::string>* strings_ = nullptr;
+    std::string reason_; // Open-Meteo explains failed requests in "reason"
+
+public:
+    static ForecastData Parse(std::string_view text) {
+        std::vector<ForecastColumns> forecasts = ParseMany(text);
+        if (forecasts.size() != 1)
+            throw std::invalid_argument("Unexpected forecast response.");
+        return Validate(forecasts.front());
+    }
+
+    // Returns the forecasts in request order without checking them, see Validate
+    static std::vector<ForecastColumns> ParseMany(std::string_view text) {
+        ForecastParser parser;
+        if (!json::sax_parse(text.data(), text.data() + text.size(), &parser))
+            throw std::invalid_argument("Parsing forecast failed.");
+        if (!parser.reason_.empty())
+            throw std::invalid_argument("Forecast request failed: " + parser.reason_);
+        return std::move(parser.forecasts_);
+    }
+
+    // Throws if some of the shown variables are missing, packs the columns otherwise
+    static ForecastData Validate(const ForecastColumns& columns) {
+        if (!columns.IsComplete())
+            throw std::invalid_argument("Unexpected forecast response.");
+        return ForecastData(columns);
+    }
+
+    // Same for the daily aggregates, the current conditions may be missing
+    static DailyForecast ValidateDaily(const ForecastColumns& columns) {
+        if (!columns.HasDaily())
+            throw std::invalid_argument("Unexpected forecast response.");
+        return DailyForecast(columns);
+    }
+
+    bool key(std::string& key) {
+        int depth = depth_ - base_;
+        if (depth == 1) {
+            in_hourly_ = key == "hourly";
+            in_daily_ = key == "daily";
+            in_current_ = key == "current";
+            reading_reason_ = key == "reason";
+            reading_utc_offset_ = key == "utc_offset_seconds";
+        } else if (depth == 2 && in_hourly_) {
+            ForecastColumns& data = forecasts_.back();
+            if (key == "temperature_2m")
+                floats_ = &data.temperature_;
+            else if (key == "apparent_temperature")
+                floats_ = &data.apparent_temperature_;
+            else if (key == "windspeed_10m")
+                floats_ = &data.windspeed_;
+            else if (key == "relativehumidity_2m")
+                bytes_ = &data.humidity_;
+            else if (key == "weathercode")
+                bytes_ = &data.weathercode_;
+        } else if (depth == 2 && in_daily_) {
+            ForecastColumns& data = forecasts_.back();
+            if (key == "time")
+                strings_ = &data.dates_;
+            else if (key == "temperature_2m_min")
+                floats_ = &data.temperature_min_;
+            else if (key == "temperature_2m_max")
+                floats_ = &data.temperature_max_;
+            else if (key == "apparent_temperature_min")
+                floats_ = &data.apparent_temperature_min_;
+            else if (key == "apparent_temperature_max")
+                floats_ = &data.apparent_temperature_max_;
+            else if (key == "wind_speed_10m_max" || key == "windspeed_10m_max")
+                floats_ = &data.windspeed_max_;
+            else if (key == "relative_humidity_2m_mean" || key == "relativehumidity_2m_mean")
+                bytes_ = &data.humidity_mean_;
+            else if (key == "weather_code" || key == "weathercode")
+                bytes_ = &data.daily_weathercode_;
+        } else if (depth == 2 && in_current_) {
+            ForecastColumns& data = forecasts_.back();
+            if (key == "temperature_2m")
+                current_ = &data.current_temperature_;
+            else if (key == "wind_speed_10m" || key == "windspeed_10m")
+                current_ = &data.current_windspeed_;
+            else if (key == "relative_humidity_2m" || key == "relativehumidity_2m")
+                current_ = &data.current_humidity_;
+            else if (key == "weather_code" || key == "weathercode")
+                current_ = &data.current_weathercode_;
+            else
+                current_ = nullptr;
+        }
+        return true;
+    }
+
+    bool null() {
+        if (InTargetArray() && floats_ != nullptr)
+            floats_->push_back(std::numeric_limits<float>::quiet_NaN());
+        else if (InTargetArray() && bytes_ != nullptr)
+            bytes_->push_back(kMissingValue);
+        return true;
+    }
+
+    bool boolean(bool) {
+        return true;
+    }
+
+    bool number_integer(json::number_integer_t value) {
+        return Number(static_cast<double>(value));
+    }
+
+    bool number_unsigned(json::number_unsigned_t value) {
+        return Number(static_cast<double>(value));
+    }
+
+    bool number_float(json::number_float_t value, const std::string&) {
+        return Number(value);
+    }
+
+    bool string(std::string& value) {
+        if (depth_ - base_ == 1 && reading_reason_)
+            reason_ = std::move(value);
+        else if (InTargetArray() && strings_ != nullptr)
+            strings_->push_back(std::move(value));
+        return true;
+    }
+
+    bool binary(json::binary_t&) {
+        return true;
+    }
+
+    bool start_object(size_t) {
+        if (depth_ == base_) {
+            ForecastColumns& data = forecasts_.emplace_back();
+            data.temperature_.reserve(kMaxDays * kHoursPerDay);
+            data.apparent_temperature_.reserve(kMaxDays * kHoursPerDay);
+            data.windspeed_.reserve(kMaxDays * kHoursPerDay);
+            data.humidity_.reserve(kMaxDays * kHoursPerDay);
+            data.weathercode_.reserve(kMaxDays * kHoursPerDay);
+            data.dates_.reserve(kMaxDays);
+            in_hourly_ = in_daily_ = in_current_ = reading_reason_ = reading_utc_offset_ = false;
+            current_ = nullptr;
+        }
+        ++depth_;
+        return true;
+    }
+
+    bool end_object() {
+        --depth_;
+        return true;
+    }
+
+    bool start_array(size_t) {
+        if (depth_ == 0)
+            base_ = 1;
+        ++depth_;
+        return true;
+    }
+
+    bool end_array() {
+        if (--depth_ - base_ == 2) {
+            floats_ = nullptr;
+            bytes_ = nullptr;
+            strings_ = nullptr;
+        }
+        return true;
+    }
+
+    bool parse_error(size_t, const std::string&, const nlohmann::detail::exception&) {
+        return false;
+    }
+
+private:
+    bool InTargetArray() const {
+        return depth_ - base_ == 3;
+    }
+
+    bool Number(double value) {
+        if (depth_ - base_ == 1 && reading_utc_offset_) {
+            forecasts_.back().utc_offset_seconds_ = static_cast<int32_t>(value);
+            reading_utc_offset_ = false;
+            return true;
+        }
+        if (depth_ - base_ == 2 && current_ != nullptr) {
+            *current_ = static_cast<float>(value);
+            current_ = nullptr;
+            return true;
+        }
+        if (!InTargetArray())
+            return true;
+        if (floats_ != nullptr)
+            floats_->push_back(static_cast<float>(value));
+        else if (bytes_ != nullptr)
+            bytes_->push_back(static_cast<uint8_t>(std::clamp(value, 0.0, 255.0)));
+        return true;
+    }
+};
+
+struct Coordinates
+{
+    double latitude_;
+    double longitude_;
+};
+
+// Reads the first match of an API-Ninjas city response, a json array of objects
+class CoordinatesParser
+{
+private:
+    int depth_ = 0;
+    size_t objects_ = 0; // objects started inside the top level array
+    bool reading_latitude_ = false;
+    bool reading_longitude_ = false;
+    bool reading_error_ = false;
+    std::optional<double> latitude_;
+    std::optional<double> longitude_;
+    std::string error_;
+
+public:
+    // Returns nothing if no city matched
+    static std::optional<Coordinates> Parse(std::string_view text) {
+        CoordinatesParser parser;
+        if (!json::sax_parse(text.data(), text.data() + text.size(), &parser))
+            throw std::invalid_argument("Parsing city coordinates failed.");
+        if (!parser.error_.empty())
+            throw std::invalid_argument("City request failed: " + parser.error_);
+        if (!parser.latitude_ || !parser.longitude_)
+            return std::nullopt;
+        return Coordinates{*parser.latitude_, *parser.longitude_};
+    }
+
+    bool key(std::string& key) {
+        bool first_match = depth_ == 2 && objects_ == 1;
+        reading_latitude_ = first_match && key == "latitude";
+        reading_longitude_ = first_match && key == "longitude";
+        reading_error_ = depth_ == 1 && key == "error"; // errors come as an object instead of an array
+        return true;
+    }
+
+    bool null() {
+        return true;
+    }
+
+    bool boolean(bool) {
+        return true;
+    }
+
+    bool number_integer(json::number_integer_t value) {
+        return Number(static_cast<double>(value));
+    }
+
+    bool number_unsigned(json::number_unsigned_t value) {
+        return Number(static_cast<double>(value));
+    }
+
+    bool number_float(json::number_float_t value, const std::string&) {
+        return Number(value);
+    }
+
+    bool string(std::string& value) {
+        if (reading_error_)
+            error_ = std::move(value);
+        return true;
+    }
+
+    bool binary(json::binary_t&) {
+        return true;
+    }
+
+    bool start_object(size_t) {
+        if (++depth_ == 2)
+            ++objects_;
+        return true;
+    }
+
+    bool end_object() {
+        --depth_;
+        return true;
+    }
+
+    bool start_array(size_t) {
+        ++depth_;
+        return true;
+    }
+
+    bool end_array() {
+        --depth_;
+        return true;
+    }
+
+    bool parse_error(size_t, const std::string&, const nlohmann::detail::exception&) {
+        return false;
+    }
+
+private:
+    bool Number(double value) {
+        if (reading_latitude_)
+            latitude_ = value;
+        else if (reading_longitude_)
+            longitude_ = value;
+        reading_latitude_ = reading_longitude_ = false;
+        return true;
+    }
+};
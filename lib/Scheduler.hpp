@@ -0,0 +1,144 @@
+#pragma once
+
+#include "Transport.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+struct RateLimit
+{
+    double requests_per_second_; // 0 - unlimited
+    double burst_; // requests that may go out at once after an idle period
+    size_t max_concurrent_;
+};
+
+// Both APIs allow about 10 requests per second on their free plans
+const RateLimit kDefaultRateLimit{10, 10, 8};
+const RateLimit kNoRateLimit{0, 0, 16};
+const uint8_t kMaxRetries = 4;
+const std::chrono::milliseconds kBaseBackoff(250);
+const std::chrono::milliseconds kMaxBackoff(8000);
+
+// Sits in front of another transport and keeps the requests of every host within its quota:
+// a token bucket spaces them out, at most max_concurrent_ are in flight and interactive
+// requests go before background ones. 429 and 5xx answers are retried with jittered
+// exponential backoff, a 429 pauses the whole host so the other requests don't run into it too.
+class SchedulingTransport : public Transport
+{
+private:
+    struct HostState {
+        double tokens_ = 0;
+        std::chrono::steady_clock::time_point refilled_ = std::chrono::steady_clock::now();
+        std::chrono::steady_clock::time_point paused_until_;
+        size_t in_flight_ = 0;
+        size_t waiting_[kPriorities] = {};
+    };
+
+    std::shared_ptr<Transport> inner_;
+    RateLimit limit_;
+    std::unordered_map<std::string, HostState> hosts_;
+    std::mutex mutex_;
+    std::condition_variable changed_;
+    std::mt19937 random_{std::random_device{}()};
+
+public:
+    explicit SchedulingTransport(std::shared_ptr<Transport> inner, RateLimit limit = kDefaultRateLimit)
+        : inner_(std::move(inner))
+        , limit_(limit)
+    {}
+
+    HttpResponse Get(const HttpRequest& request) override {
+        std::string host = UrlHost(request.url_);
+        for (uint8_t attempt = 0;; ++attempt) {
+            Acquire(host, request.priority_);
+            HttpResponse response;
+            try {
+                response = inner_->Get(request);
+            } catch (...) {
+                Release(host, std::chrono::milliseconds(0));
+                throw;
+            }
+            bool retry = attempt < kMaxRetries && (response.status_code_ == 429 || response.status_code_ >= 500);
+            std::chrono::milliseconds delay = retry ? Backoff(attempt) : std::chrono::milliseconds(0);
+            Release(host, response.status_code_ == 429 ? delay : std::chrono::milliseconds(0));
+            if (!retry)
+                return response;
+            Stats::Add(Counter::Retries);
+            if (response.status_code_ != 429)
+                std::this_thread::sleep_for(delay);
+        }
+    }
+
+    // Connecting counts against no quota, so it skips the queue
+    void Warm(const std::string& url) override {
+        inner_->Warm(url);
+    }
+
+private:
+    // Blocks until the host has a free slot, a token and no pause, and no request of a higher priority waits
+    void Acquire(const std::string& host, Priority priority) {
+        std::unique_lock lock(mutex_);
+        auto [found, created] = hosts_.try_emplace(host);
+        HostState& state = found->second;
+        if (created)
+            state.tokens_ = limit_.burst_;
+        size_t rank = static_cast<size_t>(priority);
+        ++state.waiting_[rank];
+        while (true) {
+            auto now = std::chrono::steady_clock::now();
+            Refill(state, now);
+            bool outranked = std::any_of(state.waiting_, state.waiting_ + rank, [](size_t waiting) { return waiting > 0; });
+            bool has_token = limit_.requests_per_second_ <= 0 || state.tokens_ >= 1;
+            if (!outranked && state.in_flight_ < limit_.max_concurrent_ && now >= state.paused_until_ && has_token)
+                break;
+            // Finished requests notify, the end of a pause or the next token has to be waited for
+            auto wake = now + std::chrono::seconds(1);
+            if (now < state.paused_until_) {
+                wake = state.paused_until_;
+            } else if (!has_token) {
+                auto until_token = std::chrono::duration<double>((1 - state.tokens_) / limit_.requests_per_second_);
+                wake = now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(until_token);
+            }
+            changed_.wait_until(lock, wake);
+        }
+        --state.waiting_[rank];
+        if (limit_.requests_per_second_ > 0)
+            state.tokens_ -= 1;
+        ++state.in_flight_;
+        // Lower priorities may go now
+        changed_.notify_all();
+    }
+
+    void Release(const std::string& host, std::chrono::milliseconds pause) {
+        {
+            std::lock_guard lock(mutex_);
+            HostState& state = hosts_.at(host);
+            --state.in_flight_;
+            if (pause.count() > 0)
+                state.paused_until_ = std::max(state.paused_until_, std::chrono::steady_clock::now() + pause);
+        }
+        changed_.notify_all();
+    }
+
+    void Refill(HostState& state, std::chrono::steady_clock::time_point now) const {
+        if (limit_.requests_per_second_ <= 0)
+            return;
+        double elapsed = std::chrono::duration<double>(now - state.refilled_).count();
+        state.tokens_ = std::min(limit_.burst_, state.tokens_ + elapsed * limit_.requests_per_second_);
+        state.refilled_ = now;
+    }
+
+    // Somewhere between half and all of kBaseBackoff * 2^attempt, so retries don't come back in lockstep
+    std::chrono::milliseconds Backoff(uint8_t attempt) {
+        auto ceiling = std::min(kMaxBackoff, kBaseBackoff * (1 << attempt));
+        std::lock_guard lock(mutex_);
+        double share = std::uniform_real_distribution<double>(0.5, 1.0)(random_);
+        return std::chrono::milliseconds(static_cast<int64_t>(ceiling.count() * share));
+    }
+};
@@ -0,0 +1,203 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <nlohmann/json.hpp>
+#include <optional>
+#include <string>
+
+// Build is making the table elements, Render is FTXUI's layout and drawing pass over a whole frame
+enum class Stage : uint8_t { Geocode, Forecast, Parse, Build, Render };
+const uint8_t kStages = 5;
+const char* const kStageNames[kStages] = {"Geocode", "Forecast", "Parse", "Build", "Render"};
+
+// BytesReceived counts decoded response bodies, TransferredBytes what came over the wire.
+// Allocations stays 0 unless the binary includes AllocationHook.hpp.
+enum class Counter : uint8_t {
+    CacheHits, CacheMisses, Requests, BytesReceived, TransferredBytes, NewConnections, ReusedConnections, Retries,
+    Allocations
+};
+const uint8_t kCounters = 9;
+const char* const kCounterNames[kCounters] = {
+    "Cache hits", "Cache misses", "Requests", "Bytes received", "Bytes transferred", "New connections", "Reused connections",
+    "Retries", "Allocations"
+};
+
+// Latency histogram with logarithmic buckets of 16 linear steps each (about 6% precision),
+// in the spirit of HdrHistogram. Recording is lock-free.
+class Histogram
+{
+private:
+    static const uint8_t kSubBucketBits = 4;
+    static const size_t kBuckets = (64 - kSubBucketBits + 1) << kSubBucketBits;
+
+    std::array<std::atomic<uint64_t>, kBuckets> buckets_{};
+    std::atomic<uint64_t> count_ = 0;
+    std::atomic<uint64_t> max_ = 0;
+
+public:
+    void Record(uint64_t value) {
+        buckets_[Index(value)].fetch_add(1, std::memory_order_relaxed);
+        count_.fetch_add(1, std::memory_order_relaxed);
+        uint64_t max = max_.load(std::memory_order_relaxed);
+        while (value > max && !max_.compare_exchange_weak(max, value, std::memory_order_relaxed)) {}
+    }
+
+    uint64_t Count() const {
+        return count_.load(std::memory_order_relaxed);
+    }
+
+    uint64_t Max() const {
+        return max_.load(std::memory_order_relaxed);
+    }
+
+    // Lower bound of the bucket holding the given share (0 to 1) of the recorded values
+    uint64_t Percentile(double share) const {
+        uint64_t count = Count();
+        if (count == 0)
+            return 0;
+        uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(share * count + 0.5));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < kBuckets; ++i) {
+            seen += buckets_[i].load(std::memory_order_relaxed);
+            if (seen >= rank)
+                return std::min(Value(i), Max());
+        }
+        return Max();
+    }
+
+private:
+    static size_t Index(uint64_t value) {
+        if (value < (1u << kSubBucketBits))
+            return value;
+        int exponent = std::bit_width(value) - 1;
+        uint64_t sub_bucket = (value >> (exponent - kSubBucketBits)) & ((1u << kSubBucketBits) - 1);
+        return ((exponent - kSubBucketBits + 1) << kSubBucketBits) + sub_bucket;
+    }
+
+    static uint64_t Value(size_t index) {
+        if (index < (1u << kSubBucketBits))
+            return index;
+        int exponent = (index >> kSubBucketBits) + kSubBucketBits - 1;
+        uint64_t sub_bucket = index & ((1u << kSubBucketBits) - 1);
+        return ((1ull << kSubBucketBits) + sub_bucket) << (exponent - kSubBucketBits);
+    }
+};
+
+// Process-wide timings of the fetch and render stages plus a few counters.
+// Everything is a no-op until Enable is called, so instrumented code pays one relaxed load.
+class Stats
+{
+private:
+    static inline std::atomic<bool> enabled_ = false;
+    static inline std::array<Histogram, kStages> stages_;
+    static inline std::array<std::atomic<uint64_t>, kCounters> counters_{};
+    static inline Histogram frame_allocations_;
+    static inline std::atomic<int64_t> first_table_ns_ = -1;
+
+public:
+    static void Enable() {
+        enabled_.store(true, std::memory_order_relaxed);
+    }
+
+    static bool IsEnabled() {
+        return enabled_.load(std::memory_order_relaxed);
+    }
+
+    static void Add(Counter counter, uint64_t value = 1) {
+        if (IsEnabled())
+            counters_[static_cast<uint8_t>(counter)].fetch_add(value, std::memory_order_relaxed);
+    }
+
+    static uint64_t Get(Counter counter) {
+        return counters_[static_cast<uint8_t>(counter)].load(std::memory_order_relaxed);
+    }
+
+    static void Record(Stage stage, std::chrono::nanoseconds duration) {
+        if (IsEnabled())
+            stages_[static_cast<uint8_t>(stage)].Record(duration.count());
+    }
+
+    static const Histogram& Get(Stage stage) {
+        return stages_[static_cast<uint8_t>(stage)];
+    }
+
+    // Heap allocations made between two frames of the UI
+    static void RecordFrame(uint64_t allocations) {
+        if (IsEnabled())
+            frame_allocations_.Record(allocations);
+    }
+
+    static const Histogram& FrameAllocations() {
+        return frame_allocations_;
+    }
+
+    // Time from answering the prompt until the first forecast table was built. Kept even while disabled, only the first call counts.
+    static void SetFirstTable(std::chrono::nanoseconds duration) {
+        int64_t unset = -1;
+        first_table_ns_.compare_exchange_strong(unset, duration.count(), std::memory_order_relaxed);
+    }
+
+    static std::optional<std::chrono::nanoseconds> FirstTable() {
+        int64_t ns = first_table_ns_.load(std::memory_order_relaxed);
+        if (ns < 0)
+            return std::nullopt;
+        return std::chrono::nanoseconds(ns);
+    }
+
+    static nlohmann::json ToJson() {
+        nlohmann::json result;
+        for (uint8_t stage = 0; stage < kStages; ++stage) {
+            const Histogram& histogram = stages_[stage];
+            result["stages"][kStageNames[stage]] = {
+                {"count", histogram.Count()},
+                {"p50_ns", histogram.Percentile(0.5)},
+                {"p99_ns", histogram.Percentile(0.99)},
+                {"max_ns", histogram.Max()}
+            };
+        }
+        result["frame_allocations"] = {
+            {"count", frame_allocations_.Count()},
+            {"p50", frame_allocations_.Percentile(0.5)},
+            {"p99", frame_allocations_.Percentile(0.99)},
+            {"max", frame_allocations_.Max()}
+        };
+        if (std::optional<std::chrono::nanoseconds> first_table = FirstTable())
+            result["first_table_ns"] = first_table->count();
+        for (uint8_t counter = 0; counter < kCounters; ++counter)
+            result["counters"][kCounterNames[counter]] = counters_[counter].load(std::memory_order_relaxed);
+        return result;
+    }
+
+    static void Dump(const std::filesystem::path& path) {
+        std::ofstream(path) << ToJson().dump(2) << '\n';
+    }
+};
+
+// Records the time until the end of the scope into a stage
+class StageTimer
+{
+private:
+    Stage stage_;
+    std::chrono::steady_clock::time_point start_;
+    bool enabled_;
+
+public:
+    explicit StageTimer(Stage stage)
+        : stage_(stage)
+        , enabled_(Stats::IsEnabled())
+    {
+        if (enabled_)
+            start_ = std::chrono::steady_clock::now();
+    }
+
+    ~StageTimer() {
+        if (enabled_)
+            Stats::Record(stage_, std::chrono::steady_clock::now() - start_);
+    }
+};
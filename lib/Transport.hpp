@@ -0,0 +1,214 @@
+#pragma once
+
+#include "Stats.hpp"
+
+#include <chrono>
+#include <cpr/cpr.h>
+#include <curl/curl.h>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Interactive requests (the city on screen) are let through before background prefetches
+enum class Priority : uint8_t {Interactive, Background};
+const uint8_t kPriorities = 2;
+const std::chrono::milliseconds kWarmTimeout(5000);
+
+struct HttpRequest
+{
+    std::string url_;
+    std::vector<std::pair<std::string, std::string>> parameters_;
+    std::vector<std::pair<std::string, std::string>> headers_;
+    Priority priority_ = Priority::Background;
+};
+
+struct HttpResponse
+{
+    long status_code_ = 0; // 0 - the request didn't reach the server, see error_
+    std::string text_;
+    std::string error_;
+};
+
+inline std::string UrlHost(const std::string& url) {
+    size_t begin = url.find("://");
+    begin = begin == std::string::npos ? 0 : begin + 3;
+    return url.substr(begin, url.find('/', begin) - begin);
+}
+
+// Makes the HTTP requests of the application, swapped out to record or replay traffic
+class Transport
+{
+public:
+    virtual ~Transport() = default;
+
+    virtual HttpResponse Get(const HttpRequest& request) = 0;
+
+    // Prepares a connection to the host of `url` before the first request, does nothing by default
+    virtual void Warm(const std::string&) {}
+};
+
+// Live network through cpr. Sessions are kept per host and reused, so repeated requests
+// skip DNS, TCP and TLS setup, and responses are asked for compressed.
+class CprTransport : public Transport
+{
+private:
+    std::unordered_map<std::string, std::vector<std::unique_ptr<cpr::Session>>> idle_sessions_; // key - host
+    std::mutex mutex_;
+
+public:
+    HttpResponse Get(const HttpRequest& request) override {
+        cpr::Parameters parameters;
+        for (const auto& [key, value] : request.parameters_)
+            parameters.Add({key, value});
+        cpr::Header header;
+        for (const auto& [key, value] : request.headers_)
+            header[key] = value;
+
+        std::string host = UrlHost(request.url_);
+        std::unique_ptr<cpr::Session> session = Acquire(host);
+        session->SetUrl(cpr::Url{request.url_});
+        session->SetParameters(parameters);
+        session->SetHeader(header);
+        cpr::Response response = session->Get();
+
+        long new_connections = 0;
+        curl_easy_getinfo(session->GetCurlHolder()->handle, CURLINFO_NUM_CONNECTS, &new_connections);
+        Stats::Add(new_connections > 0 ? Counter::NewConnections : Counter::ReusedConnections);
+        Stats::Add(Counter::TransferredBytes, response.downloaded_bytes);
+        Release(host, std::move(session));
+
+        return {response.status_code, std::move(response.text), response.error.message};
+    }
+
+    // A HEAD request leaves a connected session in the pool, the answer itself doesn't matter
+    void Warm(const std::string& url) override {
+        std::string host = UrlHost(url);
+        std::unique_ptr<cpr::Session> session = Acquire(host);
+        session->SetUrl(cpr::Url{url});
+        session->SetParameters(cpr::Parameters{});
+        session->SetHeader(cpr::Header{});
+        session->SetTimeout(cpr::Timeout{kWarmTimeout});
+        session->Head();
+        session->SetTimeout(cpr::Timeout{0});
+        Release(host, std::move(session));
+    }
+
+private:
+    // A session is used by one request at a time, so concurrent requests get one each
+    std::unique_ptr<cpr::Session> Acquire(const std::string& host) {
+        {
+            std::lock_guard lock(mutex_);
+            auto& idle = idle_sessions_[host];
+            if (!idle.empty()) {
+                std::unique_ptr<cpr::Session> session = std::move(idle.back());
+                idle.pop_back();
+                return session;
+            }
+        }
+        auto session = std::make_unique<cpr::Session>();
+        session->SetAcceptEncoding({cpr::AcceptEncodingMethods::gzip, cpr::AcceptEncodingMethods::deflate});
+        return session;
+    }
+
+    void Release(const std::string& host, std::unique_ptr<cpr::Session> session) {
+        std::lock_guard lock(mutex_);
+        idle_sessions_[host].push_back(std::move(session));
+    }
+};
+
+// File name of the recording of a request. Headers (the api key) are left out on purpose.
+inline std::string RecordingName(const HttpRequest& request) {
+    std::string key = request.url_;
+    for (const auto& [name, value] : request.parameters_)
+        key += '&' + name + '=' + value;
+    // FNV-1a, stable between runs and platforms unlike std::hash
+    uint64_t hash = 14695981039346656037ull;
+    for (unsigned char c : key) {
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+    std::ostringstream name;
+    name << std::hex << hash << ".json";
+    return name.str();
+}
+
+// Passes requests on to another transport and saves every request/response pair into a directory
+class RecordingTransport : public Transport
+{
+private:
+    std::shared_ptr<Transport> inner_;
+    std::filesystem::path directory_;
+
+public:
+    RecordingTransport(std::shared_ptr<Transport> inner, const std::filesystem::path& directory)
+        : inner_(std::move(inner))
+        , directory_(directory)
+    {
+        std::filesystem::create_directories(directory_);
+    }
+
+    HttpResponse Get(const HttpRequest& request) override {
+        HttpResponse response = inner_->Get(request);
+        nlohmann::json recording = {
+            {"url", request.url_},
+            {"parameters", request.parameters_},
+            {"status_code", response.status_code_},
+            {"text", response.text_},
+            {"error", response.error_}
+        };
+        std::ofstream(directory_ / RecordingName(request)) << recording.dump(2);
+        return response;
+    }
+
+    void Warm(const std::string& url) override {
+        inner_->Warm(url);
+    }
+};
+
+// Answers requests from a RecordingTransport directory without any network access.
+// Latency and failures can be injected to reproduce slow or flaky APIs.
+class ReplayTransport : public Transport
+{
+private:
+    std::filesystem::path directory_;
+    std::chrono::milliseconds latency_;
+    double failure_rate_; // share of requests answered with 503
+    std::mt19937 random_; // fixed seed, the same failures on every run
+    std::mutex mutex_;
+
+public:
+    explicit ReplayTransport(const std::filesystem::path& directory,
+                             std::chrono::milliseconds latency = std::chrono::milliseconds(0),
+                             double failure_rate = 0)
+        : directory_(directory)
+        , latency_(latency)
+        , failure_rate_(failure_rate)
+    {}
+
+    HttpResponse Get(const HttpRequest& request) override {
+        if (latency_.count() > 0)
+            std::this_thread::sleep_for(latency_);
+        {
+            std::lock_guard lock(mutex_);
+            if (failure_rate_ > 0 && std::uniform_real_distribution<double>(0, 1)(random_) < failure_rate_)
+                return {503, R"({"error": true, "reason": "Injected failure"})", ""};
+        }
+
+        std::ifstream file(directory_ / RecordingName(request));
+        if (!file)
+            return {0, "", "No recording for " + request.url_};
+        nlohmann::json recording = nlohmann::json::parse(file, nullptr, false);
+        if (recording.is_discarded())
+            return {0, "", "Damaged recording for " + request.url_};
+        return {recording.value("status_code", 0L), recording.value("text", ""), recording.value("error", "")};
+    }
+};
@@ -1,17 +1,67 @@
 #pragma once
 
 #include "API.hpp"
+#include "CityKey.hpp"
 #include "Config.hpp"
+#include "DiskCache.hpp"
+#include "ResponseParser.hpp"
+#include "Scheduler.hpp"
+#include "Stats.hpp"
+#include "ForecastData.hpp"
 
+#include <atomic>
+#include <memory>
+#include <chrono>
+#include <future>
+#include <mutex>
+#include <optional>
 #include <cpr/cpr.h>
 
 static const uint8_t kStatusCodeOK = 200;
+const size_t kForecastBatchSize = 50; // locations per Open-Meteo request, keeps the url short
+const std::chrono::seconds kMaxRefreshAhead{300};
+
+// Forecast of a location as it was downloaded, never changed afterwards. Every view has its own
+// fields and download time, a download of one view copies the fields of the other from the previous snapshot.
+// A detail download recomputes the daily aggregates from the hours, but the current conditions and
+// daily_fetched_at_ only ever come from overview downloads.
+struct ForecastSnapshot
+{
+    ForecastData forecast_; // hourly, no days until the detail view was downloaded
+    std::chrono::system_clock::time_point fetched_at_; // of forecast_
+    uint64_t generation_;
+    DailyForecast daily_; // overview, its aggregates computed from forecast_ when that is downloaded
+    std::chrono::system_clock::time_point daily_fetched_at_; // of the latest overview download
+    std::chrono::seconds utc_offset_{0}; // of the location's time zone, as of the latest download
+
+    bool Has(View view) const {
+        return view == View::Detail ? forecast_.Days() > 0 : daily_.Days() > 0;
+    }
+
+    std::chrono::system_clock::time_point FetchedAt(View view) const {
+        return view == View::Detail ? fetched_at_ : daily_fetched_at_;
+    }
+};
+
+// Latest snapshot of one city, swapped as a whole when new data is stored, empty until there is some
+using ForecastSlot = std::atomic<std::shared_ptr<const ForecastSnapshot>>;
 
 class Weather
 {
 private:
+
     static inline std::string api_key_;
-    static inline std::unordered_map<std::string, json> cities_locations_;
+    static inline std::shared_ptr<Transport> transport_ = std::make_shared<SchedulingTransport>(std::make_shared<CprTransport>());
+    static inline std::unordered_map<std::string, Coordinates> cities_locations_; // key - CityKey of the name
+    static inline std::unordered_map<std::string, std::shared_future<void>> in_flight_; // key - FlightKey or GeocodeKey
+    static inline std::unordered_map<std::string, std::shared_ptr<const ForecastSnapshot>> forecasts_; // key - "latitude,longitude,days"
+    static inline std::unordered_map<std::string, std::shared_ptr<ForecastSlot>> slots_; // key - CityKey, see Watch
+    static inline std::atomic<uint64_t> generation_ = 0; // bumped every time new forecast data is stored
+    static inline std::mutex mutex_; // guards both caches and the api key, requests are made without holding it
+    static inline DiskCache disk_cache_;
+    static inline std::mutex save_mutex_; // one save at a time, they share the temporary file
+    static inline bool cache_changed_ = false; // something was fetched since the last save
+    std::atomic<std::chrono::seconds> cache_ttl_ = kDefaultCacheTTL; // may change while the fetcher runs, see Forecast::Start
     std::filesystem::path file_;
 
 public:
@@ -19,23 +69,461 @@ public:
 
     Weather(const std::filesystem::path& path, const std::string& api) {
         file_ = path;
+        SetApiKey(api);
+    }
+
+    // Geocoding needs the key, forecasts of cities with known coordinates are downloaded without it
+    void SetApiKey(const std::string& api) {
+        std::lock_guard lock(mutex_);
         api_key_ = api;
     }
 
-    json ParseWeather(const std::string& city, uint8_t days) {
-        json json_coordinates;
-        if (cities_locations_.find(city) == cities_locations_.end()) {
-            auto coordinates = GetCoordinates(city, api_key_);
-            json_coordinates = json::parse(coordinates.text.substr(1, coordinates.text.size() - 2));
-            cities_locations_[city] = json_coordinates;
-        } else {
-            json_coordinates = cities_locations_[city];
+    // Cities whose coordinates are known, so their forecasts can be downloaded without geocoding
+    std::vector<std::string> Located(const std::vector<std::string>& cities) const {
+        std::vector<std::string> located;
+        std::lock_guard lock(mutex_);
+        for (const auto& city : cities) {
+            if (cities_locations_.contains(CityKey(city)))
+                located.push_back(city);
+        }
+        return located;
+    }
+
+    bool IsLocated(const std::string& city) const {
+        std::lock_guard lock(mutex_);
+        return cities_locations_.contains(CityKey(city));
+    }
+
+    // Asks API-Ninjas for the coordinates of the city unless they are known, returns why that failed
+    std::optional<std::string> Geocode(const std::string& city, Priority priority = Priority::Background) {
+        try {
+            Locate(city, CityKey(city), priority);
+        } catch (const std::exception& e) {
+            return e.what();
+        }
+        return std::nullopt;
+    }
+
+    // Opens connections to both APIs ahead of the first requests
+    void Warm() const {
+        transport_->Warm(ForecastDataUrl);
+        transport_->Warm(CityDataUrl);
+    }
+
+    // Replaces the rate limited live network, e.g. with a ReplayTransport. Call before any fetching starts.
+    void SetTransport(std::shared_ptr<Transport> transport) {
+        transport_ = std::move(transport);
+    }
+
+    void SetCacheTTL(std::chrono::seconds ttl) {
+        cache_ttl_.store(ttl);
+    }
+
+    // Fills the caches with whatever the previous runs saved to `path`, safe while downloads run
+    void LoadCache(const std::filesystem::path& path) {
+        DiskCache disk_cache(path);
+        DiskCache::Contents contents = disk_cache.Load();
+
+        std::lock_guard save_lock(save_mutex_);
+        std::lock_guard lock(mutex_);
+        disk_cache_ = std::move(disk_cache);
+        for (auto& location : contents.locations_) {
+            cities_locations_[CityKey(location.city_)] = {location.latitude_, location.longitude_};
+        }
+        for (auto& stored : contents.forecasts_) {
+            ForecastSnapshot snapshot;
+            snapshot.forecast_ = std::move(stored.forecast_);
+            snapshot.fetched_at_ = std::chrono::system_clock::time_point{std::chrono::seconds(stored.fetched_at_)};
+            snapshot.daily_ = std::move(stored.daily_);
+            snapshot.daily_fetched_at_ = std::chrono::system_clock::time_point{std::chrono::seconds(stored.daily_fetched_at_)};
+            snapshot.utc_offset_ = std::chrono::seconds(stored.utc_offset_);
+            // Fields downloaded since start stay, e.g. when a second cache is loaded after a prefetch
+            auto cached = forecasts_.find(stored.key_);
+            if (cached != forecasts_.end()) {
+                const ForecastSnapshot& current = *cached->second;
+                bool keep_hourly = current.fetched_at_ >= snapshot.fetched_at_;
+                bool keep_daily = current.daily_fetched_at_ >= snapshot.daily_fetched_at_;
+                if (keep_hourly && keep_daily)
+                    continue;
+                if (std::max(current.fetched_at_, current.daily_fetched_at_) >= std::max(snapshot.fetched_at_, snapshot.daily_fetched_at_))
+                    snapshot.utc_offset_ = current.utc_offset_;
+                if (keep_hourly) {
+                    snapshot.forecast_ = current.forecast_;
+                    snapshot.fetched_at_ = current.fetched_at_;
+                }
+                if (keep_daily) {
+                    snapshot.daily_ = current.daily_;
+                    snapshot.daily_fetched_at_ = current.daily_fetched_at_;
+                }
+            }
+            snapshot.generation_ = ++generation_;
+            forecasts_.insert_or_assign(stored.key_, std::make_shared<const ForecastSnapshot>(std::move(snapshot)));
+        }
+    }
+
+    // Forgets every location and forecast and the cache file, e.g. those of a config that wasn't used after all.
+    // Call while nothing is being downloaded.
+    void ClearCache() {
+        std::lock_guard save_lock(save_mutex_);
+        std::lock_guard lock(mutex_);
+        disk_cache_ = DiskCache();
+        cities_locations_.clear();
+        forecasts_.clear();
+        slots_.clear();
+        cache_changed_ = false;
+    }
+
+    // Writes the caches to the file given to LoadCache, returns false if that failed.
+    // Only the snapshot pointers are taken under the lock, they are immutable and copied out after it.
+    bool SaveCache() {
+        std::lock_guard save_lock(save_mutex_);
+        DiskCache::Contents contents;
+        std::vector<std::pair<std::string, std::shared_ptr<const ForecastSnapshot>>> snapshots;
+        {
+            std::lock_guard lock(mutex_);
+            if (disk_cache_.GetPath().empty() || !cache_changed_)
+                return true;
+            contents.locations_.reserve(cities_locations_.size());
+            for (const auto& [city, coordinates] : cities_locations_) {
+                contents.locations_.push_back({city, coordinates.latitude_, coordinates.longitude_});
+            }
+            snapshots.assign(forecasts_.begin(), forecasts_.end());
+            cache_changed_ = false;
+        }
+        auto seconds = [](std::chrono::system_clock::time_point time) {
+            return std::chrono::duration_cast<std::chrono::seconds>(time.time_since_epoch()).count();
+        };
+        contents.forecasts_.reserve(snapshots.size());
+        for (const auto& [key, cached] : snapshots) {
+            contents.forecasts_.push_back({key, seconds(cached->fetched_at_), static_cast<int32_t>(cached->utc_offset_.count()),
+                                           cached->forecast_, seconds(cached->daily_fetched_at_), cached->daily_});
+        }
+        try {
+            disk_cache_.Save(contents);
+        } catch (const std::exception&) {
+            return false;
+        }
+        return true;
+    }
+
+    // Generation of the forecast stored for the city, 0 if there is none
+    uint64_t Generation(const std::string& city) const {
+        std::lock_guard lock(mutex_);
+        auto cached = FindForecast(city);
+        return cached != forecasts_.end() ? cached->second->generation_ : 0;
+    }
+
+    bool IsFresh(const std::string& city, View view = View::Detail) const {
+        std::lock_guard lock(mutex_);
+        auto cached = FindForecast(city);
+        return cached != forecasts_.end() && IsFresh(*cached->second, view);
+    }
+
+    // The snapshot has the fields of the view and they aren't older than the TTL
+    bool IsFresh(const ForecastSnapshot& snapshot, View view = View::Detail) const {
+        return snapshot.Has(view) && std::chrono::system_clock::now() - snapshot.FetchedAt(view) < cache_ttl_.load();
+    }
+
+    // Moment the fields of the view stop being fresh
+    std::chrono::system_clock::time_point ExpiresAt(const ForecastSnapshot& snapshot, View view = View::Detail) const {
+        return snapshot.FetchedAt(view) + cache_ttl_.load();
+    }
+
+    // Slot that always holds the latest forecast of the city. Readers load it without locking
+    // and keep whatever snapshot they got, even while a newer one is being stored.
+    std::shared_ptr<const ForecastSlot> Watch(const std::string& city) {
+        std::string key = CityKey(city);
+        std::lock_guard lock(mutex_);
+        auto [slot, created] = slots_.try_emplace(key);
+        if (created) {
+            slot->second = std::make_shared<ForecastSlot>();
+            auto cached = FindForecast(key);
+            if (cached != forecasts_.end())
+                slot->second->store(cached->second);
         }
-        std::string coord_x = to_string(json_coordinates.at("latitude"));
-        std::string coord_y = to_string(json_coordinates.at("longitude"));
+        return slot->second;
+    }
+
+    // (city, view) pairs whose fields are within RefreshAhead of expiring, or past it. `next` is set to the
+    // moment the next one of the others gets there. Cities without the fields of their view are always due,
+    // e.g. because their first download failed.
+    std::vector<std::pair<std::string, View>> DueForRefresh(const std::vector<std::pair<std::string, View>>& cities,
+                                                            std::optional<std::chrono::system_clock::time_point>& next) const {
+        std::vector<std::pair<std::string, View>> due;
+        auto now = std::chrono::system_clock::now();
+        std::lock_guard lock(mutex_);
+        for (const auto& [city, view] : cities) {
+            auto cached = FindForecast(city);
+            if (cached == forecasts_.end() || !cached->second->Has(view)) {
+                due.emplace_back(city, view);
+                continue;
+            }
+            auto refresh_at = cached->second->FetchedAt(view) + cache_ttl_.load() - RefreshAhead();
+            if (refresh_at <= now)
+                due.emplace_back(city, view);
+            else if (!next || refresh_at < *next)
+                next = refresh_at;
+        }
+        return due;
+    }
+
+    // Downloads coordinates and forecast of the city unless fresh ones are already cached.
+    // Forecasts within RefreshAhead of expiring are downloaded again.
+    // Safe to call from several threads at once.
+    void Fetch(const std::string& city) {
+        auto errors = FetchMany({city}, Priority::Interactive);
+        if (!errors.empty())
+            throw std::invalid_argument(errors.front().second);
+    }
+
+    // Same as Fetch for several cities, their forecasts are downloaded kForecastBatchSize per request
+    // with the fields of `view`. A city that another call is already downloading isn't requested again,
+    // the call waits for that download and shares its result instead.
+    // Returns (city, error message) for every city that failed, the others are stored.
+    std::vector<std::pair<std::string, std::string>> FetchMany(const std::vector<std::string>& cities,
+                                                               Priority priority = Priority::Background,
+                                                               View view = View::Detail) {
+        std::vector<std::pair<std::string, std::string>> errors;
+        std::vector<std::pair<std::string, std::string>> owned; // (city, key) this call downloads
+        std::unordered_map<std::string, std::promise<void>> promises;
+        std::vector<std::pair<std::string, std::shared_future<void>>> awaited;
+        {
+            std::lock_guard lock(mutex_);
+            for (const auto& city : cities) {
+                std::string key = CityKey(city);
+                auto cached = FindForecast(key);
+                if (cached != forecasts_.end() && cached->second->Has(view)
+                    && std::chrono::system_clock::now() - cached->second->FetchedAt(view) < cache_ttl_.load() - RefreshAhead()) {
+                    Stats::Add(Counter::CacheHits);
+                    continue;
+                }
+                auto flight = in_flight_.find(FlightKey(key, view));
+                if (flight == in_flight_.end()) {
+                    Stats::Add(Counter::CacheMisses);
+                    flight = in_flight_.emplace(FlightKey(key, view), promises[key].get_future().share()).first;
+                    owned.emplace_back(city, key);
+                }
+                awaited.emplace_back(city, flight->second);
+            }
+        }
+
+        std::unordered_map<std::string, std::string> failed; // key - city key
+        try {
+            failed = Download(owned, priority, view);
+        } catch (const std::exception& e) {
+            for (const auto& [city, key] : owned)
+                failed.emplace(key, e.what());
+        }
+        {
+            std::lock_guard lock(mutex_);
+            for (auto& [key, promise] : promises) {
+                auto error = failed.find(key);
+                if (error == failed.end())
+                    promise.set_value();
+                else
+                    promise.set_exception(std::make_exception_ptr(std::runtime_error(error->second)));
+                in_flight_.erase(FlightKey(key, view));
+            }
+        }
+
+        for (const auto& [city, flight] : awaited) {
+            try {
+                flight.get();
+            } catch (const std::exception& e) {
+                errors.emplace_back(city, e.what());
+            }
+        }
+        return errors;
+    }
+
+    // Returns the cached hourly forecast of the city cut to `days` without making any requests
+    std::optional<ForecastData> TryGetWeather(const std::string& city, uint8_t days) const {
+        std::lock_guard lock(mutex_);
+        auto cached = FindForecast(city);
+        if (cached == forecasts_.end() || !cached->second->Has(View::Detail))
+            return std::nullopt;
+        return cached->second->forecast_.Slice(std::clamp(days, kMinDays, kMaxDays));
+    }
+
+    ForecastData ParseWeather(const std::string& city, uint8_t days) {
+        Fetch(city);
+        return *TryGetWeather(city, days);
+    }
+
+private:
+    // Geocodes and downloads the fields of `view` for the given (city, city key) pairs,
+    // returns an error message per failed key
+    std::unordered_map<std::string, std::string> Download(const std::vector<std::pair<std::string, std::string>>& cities,
+                                                          Priority priority, View view) {
+        std::unordered_map<std::string, std::string> errors;
+        std::vector<std::pair<std::string, Coordinates>> located; // (city key, coordinates)
+        for (const auto& [city, key] : cities) {
+            try {
+                located.emplace_back(key, Locate(city, key, priority));
+            } catch (const std::exception& e) {
+                errors.emplace(key, e.what());
+            }
+        }
+
+        for (size_t begin = 0; begin < located.size(); begin += kForecastBatchSize) {
+            size_t end = std::min(located.size(), begin + kForecastBatchSize);
+            std::vector<std::pair<std::string, std::string>> coordinates;
+            for (size_t i = begin; i < end; ++i) {
+                coordinates.emplace_back(FormatCoordinate(located[i].second.latitude_),
+                                         FormatCoordinate(located[i].second.longitude_));
+            }
+
+            std::vector<ForecastColumns> forecasts;
+            try {
+                // Always download the maximum horizon, so any smaller one is served from the cache
+                HttpResponse response_forecast;
+                {
+                    StageTimer timer(Stage::Forecast);
+                    response_forecast = GetForecasts(*transport_, coordinates, std::to_string(kMaxDays), priority, view);
+                }
+                Stats::Add(Counter::Requests);
+                Stats::Add(Counter::BytesReceived, response_forecast.text_.size());
+                CheckResponse(response_forecast);
+                StageTimer timer(Stage::Parse);
+                forecasts = ForecastParser::ParseMany(response_forecast.text_);
+                if (forecasts.size() != end - begin)
+                    throw std::invalid_argument("Unexpected forecast response.");
+            } catch (const std::exception& e) {
+                for (size_t i = begin; i < end; ++i)
+                    errors.emplace(located[i].first, e.what());
+                continue;
+            }
+
+            for (size_t i = begin; i < end; ++i) {
+                try {
+                    ForecastData forecast;
+                    DailyForecast daily;
+                    if (view == View::Detail)
+                        forecast = ForecastParser::Validate(forecasts[i - begin]);
+                    else
+                        daily = ForecastParser::ValidateDaily(forecasts[i - begin]);
+                    auto now = std::chrono::system_clock::now();
+                    std::lock_guard lock(mutex_);
+                    // The fields of the other view stay as they were
+                    std::string forecast_key = ForecastKey(located[i].second);
+                    auto cached = forecasts_.find(forecast_key);
+                    ForecastSnapshot updated = cached != forecasts_.end() ? *cached->second : ForecastSnapshot{};
+                    if (view == View::Detail) {
+                        // Newer aggregates, but the current conditions are only as fresh as the last overview
+                        updated.daily_ = DailyForecast(DailyForecast::FromHourly(forecast).Aggregates(), updated.daily_.Current());
+                        updated.forecast_ = std::move(forecast);
+                        updated.fetched_at_ = now;
+                    } else {
+                        updated.daily_ = std::move(daily);
+                        updated.daily_fetched_at_ = now;
+                    }
+                    updated.utc_offset_ = std::chrono::seconds(forecasts[i - begin].utc_offset_seconds_);
+                    updated.generation_ = ++generation_;
+                    auto snapshot = std::make_shared<const ForecastSnapshot>(std::move(updated));
+                    forecasts_.insert_or_assign(forecast_key, snapshot);
+                    // Publish to the readers of the city
+                    auto slot = slots_.find(located[i].first);
+                    if (slot != slots_.end())
+                        slot->second->store(std::move(snapshot));
+                    cache_changed_ = true;
+                } catch (const std::exception& e) {
+                    errors.emplace(located[i].first, e.what());
+                }
+            }
+        }
+        return errors;
+    }
+
+    // Coordinates of the city, asked from API-Ninjas the first time. Spellings of one city share the key,
+    // so a call for a city another call is geocoding waits for that request instead of making its own.
+    Coordinates Locate(const std::string& city, const std::string& key, Priority priority) {
+        std::string api_key;
+        std::promise<void> promise;
+        std::shared_future<void> flight;
+        bool owned = false;
+        {
+            std::lock_guard lock(mutex_);
+            auto location = cities_locations_.find(key);
+            if (location != cities_locations_.end())
+                return location->second;
+            auto geocoding = in_flight_.find(GeocodeKey(key));
+            if (geocoding == in_flight_.end()) {
+                geocoding = in_flight_.emplace(GeocodeKey(key), promise.get_future().share()).first;
+                owned = true;
+            }
+            flight = geocoding->second;
+            api_key = api_key_;
+        }
+        if (!owned) {
+            flight.get();
+            std::lock_guard lock(mutex_);
+            return cities_locations_.at(key);
+        }
+
+        try {
+            HttpResponse coordinates;
+            {
+                StageTimer timer(Stage::Geocode);
+                coordinates = GetCoordinates(*transport_, key, api_key, priority);
+            }
+            Stats::Add(Counter::Requests);
+            Stats::Add(Counter::BytesReceived, coordinates.text_.size());
+            CheckResponse(coordinates);
+            std::optional<Coordinates> parsed = CoordinatesParser::Parse(coordinates.text_);
+            if (!parsed)
+                throw std::invalid_argument("City \"" + city + "\" not found.");
+            std::lock_guard lock(mutex_);
+            cities_locations_[key] = *parsed;
+            cache_changed_ = true;
+            in_flight_.erase(GeocodeKey(key));
+            promise.set_value();
+            return *parsed;
+        } catch (...) {
+            std::lock_guard lock(mutex_);
+            in_flight_.erase(GeocodeKey(key));
+            promise.set_exception(std::current_exception());
+            throw;
+        }
+    }
+
+    // A tenth of the TTL, at most kMaxRefreshAhead
+    std::chrono::seconds RefreshAhead() const {
+        return std::min(kMaxRefreshAhead, cache_ttl_.load() / 10);
+    }
+
+    // Throws on transport errors and on statuses other than 200 that are left after the retries
+    static void CheckResponse(const HttpResponse& response) {
+        if (!response.error_.empty())
+            throw std::runtime_error(response.error_);
+        if (response.status_code_ != kStatusCodeOK)
+            throw std::runtime_error("Request failed with status " + std::to_string(response.status_code_) + ".");
+    }
+
+    // Shortest text that reads back as the same double, the way json prints numbers,
+    // so request parameters and cache keys stay the same as before
+    static std::string FormatCoordinate(double value) {
+        return json(value).dump();
+    }
+
+    // Downloads of the overview and the detail view of a city are separate flights
+    static std::string FlightKey(const std::string& key, View view) {
+        return key + (view == View::Detail ? "#detail" : "#overview");
+    }
+
+    static std::string GeocodeKey(const std::string& key) {
+        return key + "#geocode";
+    }
+
+    static std::string ForecastKey(const Coordinates& coordinates) {
+        return FormatCoordinate(coordinates.latitude_) + ',' + FormatCoordinate(coordinates.longitude_)
+               + ',' + std::to_string(kMaxDays);
+    }
 
-        auto response_forecast = GetForecast(coord_x, coord_y, std::to_string(days));
-        json json_forecast = json::parse(response_forecast.text);
-        return json_forecast;
+    // Expects mutex_ to be held, takes a city name or a city key
+    static std::unordered_map<std::string, std::shared_ptr<const ForecastSnapshot>>::const_iterator FindForecast(const std::string& city) {
+        auto location = cities_locations_.find(CityKey(city));
+        if (location == cities_locations_.end())
+            return forecasts_.end();
+        return forecasts_.find(ForecastKey(location->second));
     }
 };
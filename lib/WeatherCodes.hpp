@@ -0,0 +1,212 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <string_view>
+#include <vector>
+
+#include "ftxui/dom/elements.hpp"
+#include "ftxui/dom/node.hpp"
+#include "ftxui/screen/screen.hpp"
+
+const uint8_t kUnknownCode = 145;
+
+// ASCII art drawn next to the description, several WMO codes share one
+enum class Sprite : uint8_t {Clear, PartlyCloudy, Overcast, Drizzle, Rain, FreezingRain, Snow, Thunderstorm, Unknown};
+const size_t kSprites = 9;
+
+struct WeatherCode {
+    std::string_view name_;
+    Sprite sprite_;
+};
+
+// Every one of the 256 codes has an entry, the ones WMO doesn't define are the kUnknownCode one
+constexpr std::array<WeatherCode, 256> MakeWeatherCodes() {
+    std::array<WeatherCode, 256> codes{};
+    codes.fill({"Неизвестный Код", Sprite::Unknown});
+
+    codes[0] = {"Clear sky", Sprite::Clear};
+    codes[1] = {"Mainly clear", Sprite::PartlyCloudy};
+    codes[2] = {"Partly cloudy", Sprite::PartlyCloudy};
+    codes[3] = {"Overcast", Sprite::Overcast};
+
+    codes[45] = codes[48] = {"Fog", Sprite::Overcast};
+
+    codes[51] = {"Light drizzle", Sprite::Drizzle};
+    codes[53] = {"Moderate drizzle", Sprite::Drizzle};
+    codes[55] = {"Dense drizzle", Sprite::Drizzle};
+    codes[56] = {"Light freezing drizzle", Sprite::Drizzle};
+    codes[57] = {"Dense freezing drizzle", Sprite::Drizzle};
+
+    codes[61] = {"Slight rain", Sprite::Drizzle};
+    codes[63] = {"Moderate rain", Sprite::Rain};
+    codes[65] = {"Heavy rain", Sprite::Rain};
+
+    codes[66] = {"Light freezing rain", Sprite::FreezingRain};
+    codes[67] = {"Heavy freezing rain", Sprite::FreezingRain};
+
+    codes[71] = {"Slight snow fall", Sprite::Snow};
+    codes[73] = {"Moderate snow fall", Sprite::Snow};
+    codes[75] = {"Heavy snow fall", Sprite::Snow};
+
+    codes[77] = {"Snow grains", Sprite::Snow};
+
+    codes[80] = {"Slight rain showers", Sprite::Rain};
+    codes[81] = {"Moderate rain showers", Sprite::Rain};
+    codes[82] = {"Violent rain showers", Sprite::Rain};
+
+    codes[95] = {"Thunderstorm", Sprite::Thunderstorm};
+    codes[96] = {"Thunderstorm with slight hail", Sprite::Thunderstorm};
+    codes[99] = {"Thunderstorm with heavy hail", Sprite::Thunderstorm};
+    return codes;
+}
+
+inline constexpr std::array<WeatherCode, 256> kWeatherCodes = MakeWeatherCodes();
+
+// A run of equally colored characters within a sprite line
+struct SpriteSpan {
+    std::string_view text_;
+    ftxui::Color::Palette16 color_;
+};
+using SpriteLines = std::vector<std::vector<SpriteSpan>>;
+
+// Indexed by Sprite, built once
+inline const std::array<SpriteLines, kSprites> kSpriteLines = [] {
+    using ftxui::Color;
+    std::array<SpriteLines, kSprites> sprites;
+
+    sprites[size_t(Sprite::Clear)] = {
+        {{"    \\    |    /   ", Color::YellowLight}},
+        {{"     '.-----.'     ", Color::YellowLight}},
+        {{"     /       \\    ", Color::YellowLight}},
+        {{" ---|         |--- ", Color::YellowLight}},
+        {{"     \\       /    ", Color::YellowLight}},
+        {{"     ,'-----'.     ", Color::YellowLight}},
+        {{"    /    |    \\   ", Color::YellowLight}}};
+
+    sprites[size_t(Sprite::PartlyCloudy)] = {
+        {{"    \\    ", Color::YellowLight}, {"|", Color::White}, {"~       ~~", Color::GrayLight}},
+        {{"     '.--", Color::YellowLight}, {"|", Color::White}, {",----,    ", Color::GrayLight}},
+        {{"     /   ", Color::YellowLight}, {"|", Color::White}, {" --   )~  ", Color::GrayLight}},
+        {{" ---|    ", Color::YellowLight}, {"|", Color::White}, {" '-'   )  ", Color::GrayLight}},
+        {{"     \\   ", Color::YellowLight}, {"|", Color::White}, {"--/    )  ", Color::GrayLight}},
+        {{"     ,'--", Color::YellowLight}, {"|", Color::White}, {"\"-----'    ", Color::GrayLight}},
+        {{"    /    ", Color::YellowLight}, {"|", Color::White}, {"     ~~  ", Color::GrayLight}}};
+
+    sprites[size_t(Sprite::Overcast)] = {
+        {{"  ~~     ~~~      ~~", Color::White}},
+        {{"   ,-----,,----,", Color::GrayLight}, {"~~  ", Color::White}},
+        {{"  (  --    --   )", Color::GrayLight}, {"~~ ", Color::White}},
+        {{" (   '-'   '-'   )  ", Color::GrayLight}},
+        {{" ~", Color::White}, {"(     ---/    )   ", Color::GrayLight}},
+        {{"   '-----\"\"----' ", Color::GrayLight}, {"~~ ", Color::White}},
+        {{"     ~~~      ~~~   ", Color::White}}};
+
+    sprites[size_t(Sprite::Drizzle)] = {
+        {{"   ,-----,,----,    ", Color::GrayLight}},
+        {{"  (  --    --   )   ", Color::GrayLight}},
+        {{" (   '-'   '-'   )  ", Color::GrayLight}},
+        {{"  (      ---/    )  ", Color::GrayLight}},
+        {{"   '---,-\"\"--,--'   ", Color::GrayLight}},
+        {{"  , , ,  ,  , ,     ", Color::BlueLight}},
+        {{" , ,   ,  , ,       ", Color::BlueLight}}};
+
+    sprites[size_t(Sprite::Rain)] = {
+        {{"   ,-----,,----,    ", Color::GrayDark}},
+        {{"  (  -^-   -^-  )   ", Color::GrayDark}},
+        {{" (   '.'   '.'   )  ", Color::GrayDark}},
+        {{"  (     _---_    )   ", Color::GrayDark}},
+        {{"   '---,-\"\"--,--'  ", Color::GrayDark}},
+        {{"  /  /    / /  /    ", Color::Blue}},
+        {{"  /  / /   /   /    ", Color::Blue}}};
+
+    sprites[size_t(Sprite::FreezingRain)] = {
+        {{"   ,-----,,----,    ", Color::GrayDark}},
+        {{"  (  -^-   -^-  )   ", Color::GrayDark}},
+        {{" (   '.'   '.'   )  ", Color::GrayDark}},
+        {{"  (     _---_    )  ", Color::GrayDark}},
+        {{"   '---,-\"\"--,--'   ", Color::GrayDark}},
+        {{"  *  ", Color::White}, {"/  ", Color::BlueLight}, {"* ", Color::White}, {"/ ", Color::BlueLight},
+         {"*  ", Color::White}, {"/ ", Color::BlueLight}, {"*  ", Color::White}},
+        {{" /  ", Color::BlueLight}, {"* ", Color::White}, {"/ ", Color::BlueLight}, {"* ", Color::White},
+         {"/  ", Color::BlueLight}, {"* ", Color::White}, {"/    ", Color::BlueLight}}};
+
+    sprites[size_t(Sprite::Snow)] = {
+        {{"   ,-----,,----,   ", Color::GrayLight}},
+        {{"  (  --    --   )  ", Color::GrayLight}},
+        {{" (   '-'   '-'   ) ", Color::GrayLight}},
+        {{"  (      ---/    ) ", Color::GrayLight}},
+        {{"   '---,-\"\"--,-'   ", Color::GrayLight}},
+        {{"   *  *   * *  *   ", Color::White}},
+        {{"  *  *  *  *  *    ", Color::White}}};
+
+    sprites[size_t(Sprite::Thunderstorm)] = {
+        {{"   ,-----,,----,      ", Color::GrayDark}},
+        {{"  (  -^-   -^-  )     ", Color::GrayDark}},
+        {{" (    .     .    )    ", Color::GrayDark}},
+        {{"  (   \\^-^-^/    )   ", Color::GrayDark}},
+        {{"   ',,-,--,,--,-'     ", Color::GrayDark}},
+        {{"    //    //  //      ", Color::YellowLight}},
+        {{"    \\\\   \\\\   \\\\  ", Color::YellowLight}},
+        {{"    /    /     /      ", Color::YellowLight}}};
+
+    sprites[size_t(Sprite::Unknown)] = {
+        {{"   ,------.   ", Color::Magenta}},
+        {{"  '  .--.  '  ", Color::Magenta}},
+        {{"  '--' _|  |  ", Color::Magenta}},
+        {{"    .--' __'  ", Color::Magenta}},
+        {{"    `---'     ", Color::Magenta}},
+        {{"    .---.     ", Color::Magenta}},
+        {{"    '---'     ", Color::Magenta}}};
+    return sprites;
+}();
+
+// Draws the shared sprite lines straight into the screen, one node per cell
+// instead of a text element per colored run
+class SpriteNode : public ftxui::Node
+{
+private:
+    const SpriteLines& lines_;
+
+public:
+    explicit SpriteNode(const SpriteLines& lines) : lines_(lines) {}
+
+    void ComputeRequirement() override {
+        int width = 0;
+        for (const auto& line : lines_) {
+            int line_width = 0;
+            for (const auto& span : line)
+                line_width += static_cast<int>(span.text_.size());
+            width = std::max(width, line_width);
+        }
+        requirement_.min_x = width;
+        requirement_.min_y = static_cast<int>(lines_.size());
+    }
+
+    void Render(ftxui::Screen& screen) override {
+        int y = box_.y_min;
+        for (const auto& line : lines_) {
+            if (y > box_.y_max)
+                return;
+            int x = box_.x_min;
+            for (const auto& span : line) {
+                for (char symbol : span.text_) {
+                    if (x > box_.x_max)
+                        break;
+                    ftxui::Pixel& pixel = screen.PixelAt(x++, y);
+                    pixel.character = symbol;
+                    pixel.foreground_color = span.color_;
+                }
+            }
+            ++y;
+        }
+    }
+};
+
+inline std::string_view GetCodeName(uint8_t code) {
+    return kWeatherCodes[code].name_;
+}
+
+inline ftxui::Element GetCodeImage(uint8_t code) {
+    return std::make_shared<SpriteNode>(kSpriteLines[size_t(kWeatherCodes[code].sprite_)]);
+}
@@ -0,0 +1,348 @@
+// Behaviour tests of the library. Runs without network access, requests go to a fake transport.
+// Exits with 1 if a check failed.
+
+#include "Fetcher.hpp"
+#include "DiskCache.hpp"
+#include "ResponseParser.hpp"
+#include "Weather.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+int failures = 0;
+
+void Check(bool condition, const char* expression, int line) {
+    if (!condition) {
+        std::cerr << "test.cpp:" << line << ": check failed: " << expression << '\n';
+        ++failures;
+    }
+}
+
+#define CHECK(condition) Check(condition, #condition, __LINE__)
+
+template <typename Exception, typename Function>
+bool Throws(Function function) {
+    try {
+        function();
+    } catch (const Exception&) {
+        return true;
+    }
+    return false;
+}
+
+bool Near(float value, float expected) {
+    return std::abs(value - expected) < 0.05f;
+}
+
+// json array of `count` numbers, start, start + step, ..., with null in place of the one at `missing`
+std::string Numbers(size_t count, double start, double step, size_t missing = SIZE_MAX) {
+    std::string numbers = "[";
+    for (size_t i = 0; i < count; ++i) {
+        numbers += i ? "," : "";
+        numbers += i == missing ? "null" : std::to_string(start + step * static_cast<double>(i));
+    }
+    return numbers + "]";
+}
+
+// Open-Meteo answer to a detail request for one day, with the old variable names the request uses.
+// Temperature and humidity miss hour 7.
+std::string DetailResponse(int utc_offset = 3600) {
+    return "{\"latitude\":51.5,\"longitude\":-0.12,\"utc_offset_seconds\":" + std::to_string(utc_offset) + ","
+           "\"hourly_units\":{\"temperature_2m\":\"°C\"},"
+           "\"hourly\":{\"time\":[\"2024-05-01T00:00\"],"
+           "\"temperature_2m\":" + Numbers(kHoursPerDay, 10, 0.5, 7) + ","
+           "\"relativehumidity_2m\":" + Numbers(kHoursPerDay, 50, 1, 7) + ","
+           "\"apparent_temperature\":" + Numbers(kHoursPerDay, 8, 0.5) + ","
+           "\"weathercode\":" + Numbers(kHoursPerDay, 3, 0) + ","
+           "\"windspeed_10m\":" + Numbers(kHoursPerDay, 12, 0.1) + "},"
+           "\"daily\":{\"time\":[\"2024-05-01\"],\"weathercode\":[3]}}";
+}
+
+// Same for an overview request, two days and the current conditions
+std::string OverviewResponse() {
+    return "{\"latitude\":51.5,\"longitude\":-0.12,\"utc_offset_seconds\":-18000,"
+           "\"current\":{\"time\":\"2024-05-01T12:00\",\"interval\":900,\"temperature_2m\":17.3,"
+           "\"relative_humidity_2m\":64,\"weather_code\":2,\"wind_speed_10m\":9.4},"
+           "\"daily\":{\"time\":[\"2024-05-01\",\"2024-05-02\"],\"weather_code\":[2,61],"
+           "\"temperature_2m_max\":[19.5,16.1],\"temperature_2m_min\":[9.2,null],"
+           "\"apparent_temperature_max\":[18.0,15.0],\"apparent_temperature_min\":[7.5,6.0],"
+           "\"wind_speed_10m_max\":[21.3,30.0],\"relative_humidity_2m_mean\":[70,null]}}";
+}
+
+// Answers geocodes with coordinates no other geocode got, across instances as the forecast cache is shared,
+// and forecasts with DetailResponse, as an array when several locations were asked for.
+// Counts the requests and holds each for a while, so concurrent calls overlap.
+class CountingTransport : public Transport
+{
+public:
+    std::atomic<int> geocodes_ = 0;
+    std::atomic<int> forecasts_ = 0;
+
+    HttpResponse Get(const HttpRequest& request) override {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        if (request.url_ == CityDataUrl) {
+            static std::atomic<int> geocoded = 0;
+            ++geocodes_;
+            return {200, "[{\"name\":\"x\",\"latitude\":" + std::to_string(10 + ++geocoded) + ",\"longitude\":20.5}]", ""};
+        }
+        ++forecasts_;
+        const std::string& latitudes = request.parameters_.front().second;
+        size_t locations = std::count(latitudes.begin(), latitudes.end(), ',') + 1;
+        if (locations == 1)
+            return {200, DetailResponse(), ""};
+        std::string text = "[";
+        for (size_t i = 0; i < locations; ++i)
+            text += (i ? "," : "") + DetailResponse();
+        return {200, text + "]", ""};
+    }
+};
+
+// The typed columns hold what the render path used to look up in the json DOM, whichever parser built them
+void TestParserMatchesJsonDom() {
+    std::string text = DetailResponse();
+    json dom = json::parse(text);
+    ForecastData parsed = ForecastParser::Parse(text);
+    ForecastData from_dom = ForecastData::FromJson(dom);
+    CHECK(parsed.Days() == from_dom.Days());
+    CHECK(parsed.Block() == from_dom.Block());
+
+    const json& hourly = dom["hourly"];
+    bool same = parsed.Hours() == hourly["temperature_2m"].size();
+    for (size_t hour = 0; same && hour < parsed.Hours(); ++hour) {
+        const json& temperature = hourly["temperature_2m"][hour];
+        const json& humidity = hourly["relativehumidity_2m"][hour];
+        same = (temperature.is_null() ? std::isnan(parsed.Temperature(hour))
+                                      : std::abs(parsed.Temperature(hour) - temperature.get<float>()) < 0.05f)
+               && (humidity.is_null() ? parsed.Humidity(hour) == kMissingValue : parsed.Humidity(hour) == humidity.get<int>())
+               && std::abs(parsed.ApparentTemperature(hour) - hourly["apparent_temperature"][hour].get<float>()) < 0.05f
+               && std::abs(parsed.Windspeed(hour) - hourly["windspeed_10m"][hour].get<float>()) < 0.05f
+               && parsed.WeatherCode(hour) == hourly["weathercode"][hour].get<int>();
+    }
+    CHECK(same);
+    CHECK(parsed.Date(0) == dom["daily"]["time"][0].get<std::string>());
+}
+
+std::string ReadFile(const std::filesystem::path& path) {
+    std::ifstream file(path, std::ios::binary);
+    return {std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+}
+
+void WriteFile(const std::filesystem::path& path, const std::string& contents) {
+    std::ofstream(path, std::ios::binary | std::ios::trunc) << contents;
+}
+
+void TestDiskCache() {
+    std::filesystem::path path = std::filesystem::temp_directory_path() / "forecast_test_cache.bin";
+    DiskCache cache(path);
+
+    DiskCache::Contents contents;
+    contents.locations_.push_back({"london", 51.5072, -0.1276});
+    contents.locations_.push_back({std::string(70000, 'x'), 1, 2}); // too long for the file, left out
+    contents.locations_.push_back({"são paulo", -23.55, -46.63});
+    ForecastData forecast = ForecastParser::Parse(DetailResponse());
+    DailyForecast daily = ForecastParser::ValidateDaily(ForecastParser::ParseMany(OverviewResponse()).front());
+    contents.forecasts_.push_back({"51.5072,-0.1276", 1714550400, 3600, forecast, 1714554000, daily});
+    contents.forecasts_.push_back({"-23.55,-46.63", 1714550400, -10800, ForecastData(), 1714554000, daily}); // overview only
+    cache.Save(contents);
+
+    DiskCache::Contents loaded = cache.Load();
+    CHECK(loaded.locations_.size() == 2);
+    CHECK(loaded.forecasts_.size() == 2);
+    if (loaded.locations_.size() == 2 && loaded.forecasts_.size() == 2) {
+        CHECK(loaded.locations_[1].city_ == "são paulo");
+        CHECK(loaded.locations_[1].latitude_ == -23.55 && loaded.locations_[1].longitude_ == -46.63);
+        const DiskCache::StoredForecast& stored = loaded.forecasts_[0];
+        CHECK(stored.key_ == "51.5072,-0.1276");
+        CHECK(stored.fetched_at_ == 1714550400 && stored.daily_fetched_at_ == 1714554000);
+        CHECK(stored.utc_offset_ == 3600);
+        CHECK(stored.forecast_.Block() == forecast.Block());
+        CHECK(stored.forecast_.Date(0) == "2024-05-01");
+        CHECK(stored.daily_.Days() == 2 && Near(stored.daily_.TemperatureMax(0), 19.5f));
+        CHECK(stored.daily_.HasCurrent() && Near(stored.daily_.CurrentTemperature(), 17.3f));
+        CHECK(loaded.forecasts_[1].forecast_.Days() == 0);
+        CHECK(loaded.forecasts_[1].utc_offset_ == -10800);
+    }
+
+    // Files of another version, byte order or a cut off one are ignored as a whole
+    std::string saved = ReadFile(path);
+    std::string other_version = saved;
+    other_version[sizeof(kCacheMagic)] ^= 0x7f;
+    WriteFile(path, other_version);
+    CHECK(cache.Load().forecasts_.empty());
+
+    std::string other_byte_order = saved;
+    std::reverse(other_byte_order.begin() + sizeof(kCacheMagic) + 4, other_byte_order.begin() + sizeof(kCacheMagic) + 8);
+    WriteFile(path, other_byte_order);
+    CHECK(cache.Load().locations_.empty());
+
+    WriteFile(path, saved.substr(0, saved.size() - 1));
+    CHECK(cache.Load().forecasts_.empty());
+
+    std::filesystem::remove(path);
+    CHECK(cache.Load().locations_.empty());
+}
+
+void TestForecastParser() {
+    ForecastData forecast = ForecastParser::Parse(DetailResponse());
+    CHECK(forecast.Days() == 1);
+    CHECK(forecast.Hours() == kHoursPerDay);
+    CHECK(Near(forecast.Temperature(3), 11.5f));
+    CHECK(std::isnan(forecast.Temperature(7)));
+    CHECK(Near(forecast.ApparentTemperature(3), 9.5f));
+    CHECK(Near(forecast.Windspeed(10), 13.0f));
+    CHECK(forecast.Humidity(5) == 55);
+    CHECK(forecast.Humidity(7) == kMissingValue);
+    CHECK(forecast.WeatherCode(0) == 3);
+    CHECK(forecast.Date(0) == "2024-05-01");
+
+    CHECK(Throws<std::invalid_argument>([] { ForecastParser::Parse("{\"error\":true,\"reason\":\"Invalid latitude\"}"); }));
+    CHECK(Throws<std::invalid_argument>([] { ForecastParser::Parse("{\"hourly\":{\"time\":["); }));
+    CHECK(Throws<std::invalid_argument>([] {
+        ForecastParser::Parse("{\"hourly\":{\"time\":[\"2024-05-01T00:00\"],\"temperature_2m\":[1]},\"daily\":{\"time\":[\"2024-05-01\"]}}");
+    }));
+}
+
+void TestCoordinatesParser() {
+    std::optional<Coordinates> coordinates = CoordinatesParser::Parse(
+            "[{\"name\":\"London\",\"latitude\":51.5072,\"longitude\":-0.1276},"
+            "{\"name\":\"London\",\"latitude\":42.98,\"longitude\":-81.24}]");
+    CHECK(coordinates.has_value());
+    CHECK(coordinates && coordinates->latitude_ == 51.5072 && coordinates->longitude_ == -0.1276);
+    CHECK(!CoordinatesParser::Parse("[]").has_value());
+    CHECK(Throws<std::invalid_argument>([] { CoordinatesParser::Parse("{\"error\":\"Invalid API Key.\"}"); }));
+    CHECK(Throws<std::invalid_argument>([] { CoordinatesParser::Parse("[{\"latitude\":"); }));
+}
+
+// Responses for several locations are split back in request order, the cities go out in one request
+void TestBatchedForecasts() {
+    std::vector<ForecastColumns> many = ForecastParser::ParseMany("[" + DetailResponse(0) + "," + DetailResponse(7200) + "]");
+    CHECK(many.size() == 2);
+    CHECK(many.size() == 2 && many[0].utc_offset_seconds_ == 0 && many[1].utc_offset_seconds_ == 7200);
+    CHECK(many.size() == 2 && many[1].IsComplete());
+    CHECK(Throws<std::invalid_argument>([] { ForecastParser::Parse("[" + DetailResponse() + "," + DetailResponse() + "]"); }));
+
+    auto transport = std::make_shared<CountingTransport>();
+    Weather weather("", "key");
+    weather.SetTransport(transport);
+    CHECK(weather.FetchMany({"Batch One", "Batch Two", "Batch Three"}).empty());
+    CHECK(transport->geocodes_ == 3);
+    CHECK(transport->forecasts_ == 1);
+    CHECK(weather.IsFresh("Batch One") && weather.IsFresh("Batch Two") && weather.IsFresh("Batch Three"));
+}
+
+void TestFetchCoalescing() {
+    auto transport = std::make_shared<CountingTransport>();
+    Weather weather("", "key");
+    weather.SetTransport(transport);
+
+    // Concurrent calls for spellings of one city share one geocode and one forecast download
+    std::vector<std::pair<std::string, std::string>> first_errors;
+    std::vector<std::pair<std::string, std::string>> second_errors;
+    std::thread first([&] { first_errors = weather.FetchMany({"Coalesce Town"}); });
+    std::thread second([&] { second_errors = weather.FetchMany({"coalesce town "}, Priority::Interactive); });
+    first.join();
+    second.join();
+    CHECK(first_errors.empty() && second_errors.empty());
+    CHECK(transport->geocodes_ == 1);
+    CHECK(transport->forecasts_ == 1);
+    CHECK(weather.IsFresh("COALESCE TOWN"));
+    CHECK(weather.TryGetWeather("Coalesce Town", kMaxDays).has_value());
+
+    // A fresh forecast is served from the cache
+    CHECK(weather.FetchMany({"Coalesce Town"}).empty());
+    CHECK(transport->geocodes_ == 1 && transport->forecasts_ == 1);
+}
+
+// Overview responses have daily aggregates and the current conditions but no hours
+void TestOverviewParser() {
+    ForecastColumns overview = ForecastParser::ParseMany(OverviewResponse()).front();
+    CHECK(overview.utc_offset_seconds_ == -18000);
+    CHECK(!overview.IsComplete());
+    CHECK(Throws<std::invalid_argument>([&] { ForecastParser::Validate(overview); }));
+    DailyForecast daily = ForecastParser::ValidateDaily(overview);
+    CHECK(daily.Days() == 2);
+    CHECK(Near(daily.TemperatureMax(0), 19.5f));
+    CHECK(std::isnan(daily.TemperatureMin(1)));
+    CHECK(Near(daily.WindspeedMax(1), 30.0f));
+    CHECK(daily.Aggregates()[1].weathercode_ == 61);
+    CHECK(daily.Aggregates()[1].humidity_mean_ == kMissingValue);
+    CHECK(daily.HasCurrent());
+    CHECK(Near(daily.CurrentTemperature(), 17.3f));
+    CHECK(Near(daily.CurrentWindspeed(), 9.4f));
+    CHECK(ForecastParser::ParseMany(DetailResponse(32400)).front().utc_offset_seconds_ == 32400);
+
+    // Without a "current" object there are no current conditions
+    CHECK(!ForecastParser::ValidateDaily(ForecastParser::ParseMany(
+            "{\"daily\":{\"time\":[\"2024-05-01\"],\"weather_code\":[2],\"temperature_2m_max\":[19.5],\"temperature_2m_min\":[9.2],"
+            "\"apparent_temperature_max\":[18.0],\"apparent_temperature_min\":[7.5],\"wind_speed_10m_max\":[21.3],"
+            "\"relative_humidity_2m_mean\":[70]}}").front()).HasCurrent());
+}
+
+// Spellings of one city queued separately still make a single geocode request
+void TestFetcherGeocodesOnce() {
+    auto transport = std::make_shared<CountingTransport>();
+    Weather weather("", "key");
+    weather.SetTransport(transport);
+    {
+        Fetcher fetcher(weather);
+        fetcher.Prefetch({"Spelling City", "spelling city", "SPELLING CITY "}, View::Detail);
+        fetcher.Wait();
+        CHECK(!fetcher.GetError("spelling city").has_value());
+    }
+    CHECK(transport->geocodes_ == 1);
+    CHECK(transport->forecasts_ == 1);
+    CHECK(weather.IsFresh("Spelling City"));
+}
+
+// Configs the application can't work with are rejected with an error instead of failing later
+void TestConfigValidation() {
+    std::filesystem::path path = std::filesystem::temp_directory_path() / "forecast_test_config.json";
+    auto parse = [&](const std::string& text) {
+        WriteFile(path, text);
+        ConfigParser parser(path);
+        parser.Parse();
+        return parser.GetConfig();
+    };
+    Config config = parse("{\"cities\":[\"london\",\"Moscow\"],\"days\":16,\"cache_ttl\":60}");
+    CHECK(config.cities_.size() == 2 && config.num_days_ == 16 && config.cache_ttl_ == std::chrono::seconds(60));
+    CHECK(Throws<std::invalid_argument>([&] { parse("{\"cities\":[],\"days\":3}"); }));
+    CHECK(Throws<std::invalid_argument>([&] { parse("{\"cities\":[\"london\"],\"days\":0}"); }));
+    CHECK(Throws<std::invalid_argument>([&] { parse("{\"cities\":[\"london\"],\"days\":17}"); }));
+    CHECK(Throws<std::invalid_argument>([&] { parse("{\"cities\":[\"london\"],\"days\":3,\"cache_ttl\":-5}"); }));
+    CHECK(Throws<std::invalid_argument>([&] { parse("{\"cities\":[\"london\"],\"days\":3,\"cache_ttl\":0}"); }));
+    std::filesystem::remove(path);
+}
+
+} // namespace
+
+int main() {
+    TestParserMatchesJsonDom();
+    TestDiskCache();
+    TestForecastParser();
+    TestCoordinatesParser();
+    TestBatchedForecasts();
+    TestFetchCoalescing();
+    TestOverviewParser();
+    TestFetcherGeocodesOnce();
+    TestConfigValidation();
+    if (failures != 0) {
+        std::cerr << failures << " checks failed\n";
+        return 1;
+    }
+    std::cout << "All tests passed\n";
+    return 0;
+}